@@ -0,0 +1,33 @@
+// runs arbitrary bytes as a ROM for a fixed number of frames.
+// first two bytes are the held keys, held on odd frames and released on even
+// ones so FX0A can complete
+#include "frame.h"
+#include "fuzz.h"
+#include "state.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FUZZ_IPS (6'000) // 100 instructions a frame
+#define FUZZ_FRAMES (16)
+
+int LLVMFuzzerInitialize(int *, char ***) { return fuzz_init(FUZZ_IPS, true); }
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < sizeof(uint16_t))
+    return -1; // not added to the corpus
+  uint16_t keys = data[0] | data[1] << 8;
+  data += sizeof(uint16_t);
+  size -= sizeof(uint16_t);
+
+  if (size > sizeof(STATE.mmap->memory))
+    size = sizeof(STATE.mmap->memory);
+  fuzz_reset(size);
+  memcpy(STATE.mmap->memory, data, size);
+  for (uint32_t frame = 0; frame < FUZZ_FRAMES; frame++) {
+    STATE.keys = frame % 2 ? keys : 0;
+    if (frame_run() == -1)
+      break;
+  }
+  return 0;
+}
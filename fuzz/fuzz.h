@@ -0,0 +1,44 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+// shared by the fuzz targets. chip8_load clears all memory and copies the
+// font on every call, so a machine is built once and every iteration starts
+// from a copy of it
+#include "decode.h"
+#include "state.h"
+#include <stdlib.h>
+#include <string.h>
+
+static state_t BASE;
+static uint8_t IMAGE[MEMORY_SIZE];
+static size_t LOADED = 0; // bytes the previous input put at PROGRAM_START
+
+// targets which never run code go without a decode cache
+static int fuzz_init(instructions_per_second_t ips, bool cached) {
+  STATE.mmap = state_memory_alloc();
+  STATE.cache = cached ? calloc(DECODE_CACHE, sizeof(*STATE.cache)) : nullptr;
+  if (STATE.mmap == nullptr || (cached && STATE.cache == nullptr))
+    return -1;
+  state_reset(ips, (address_t){PROGRAM_START});
+  memcpy(IMAGE, STATE.mmap, MEMORY_SIZE);
+  memcpy(&BASE, &STATE, sizeof(BASE));
+  return 0;
+}
+
+// BASE.mmap is STATE.mmap, so the registers copy keeps the pointer. `size`
+// bytes of input go to PROGRAM_START next. entries stay where nothing changed:
+// only both inputs and pages the previous run wrote differ from what they
+// were decoded from
+static inline void fuzz_reset(size_t size) {
+  uint16_t dirty = STATE.dirty;
+  memcpy(STATE.mmap, IMAGE, MEMORY_SIZE);
+  memcpy(&STATE, &BASE, sizeof(STATE));
+  decode_invalidate((address_t){PROGRAM_START}, size > LOADED ? size : LOADED);
+  LOADED = size;
+  for (uint32_t p = 0; p < MEMORY_SIZE / STATE_PAGE_SIZE; p++) {
+    if (dirty & 1 << p)
+      decode_invalidate((address_t){p * STATE_PAGE_SIZE}, STATE_PAGE_SIZE);
+  }
+}
+
+#endif
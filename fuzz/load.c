@@ -0,0 +1,29 @@
+// loads arbitrary bytes as a program file. first two bytes are the start
+// address, as given with `-s`
+#include "fuzz.h"
+#include "state.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+int LLVMFuzzerInitialize(int *, char ***) {
+  return fuzz_init(DEFAULT_IPS, false);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  // fmemopen does not take empty buffers
+  if (size <= sizeof(uint16_t))
+    return -1;
+  address_t start = {data[0] | data[1] << 8};
+  data += sizeof(uint16_t);
+  size -= sizeof(uint16_t);
+
+  fuzz_reset(0);
+  STATE.registers.PC = start;
+  FILE *prog = fmemopen((void *)data, size, "rb");
+  if (prog == nullptr)
+    return 0;
+  state_load_program(prog);
+  fclose(prog);
+  return 0;
+}
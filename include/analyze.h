@@ -0,0 +1,48 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "decode.h"
+#include "instructions.h"
+#include "state.h"
+#include <stdint.h>
+
+#define ANALYZE_PAGE_SIZE (256)
+#define ANALYZE_NONE (UINT16_MAX)
+
+typedef enum : uint8_t {
+  BYTE_UNKNOWN,
+  BYTE_CODE,    // first byte of a reachable instruction
+  BYTE_OPERAND, // second byte of a reachable instruction
+  BYTE_DATA,    // accessed through I set by ANNN, sprites and tables
+} byte_kind_t;
+
+typedef struct {
+  uint16_t start;   // first instruction
+  uint16_t end;     // past the last instruction
+  uint16_t next[2]; // successors, ANALYZE_NONE if there is none. for a call
+                    // target and return address
+  flow_t flow;      // of the last instruction
+} block_t;
+
+typedef struct {
+  address_t entry;
+  byte_kind_t map[MEMORY_SIZE];
+  // bit n set - page n (address / ANALYZE_PAGE_SIZE) is written by FX33 or
+  // FX55, stack and screen pages are not counted
+  uint16_t written_pages;
+  bool written_unknown; // FX33 or FX55 with I not known, any page can change
+  bool indirect;        // BNNN was reached, map may miss code behind it
+  uint16_t blocks_count;
+  // jumps to odd addresses and skips into the middle of instructions let
+  // every byte start a block
+  block_t blocks[MEMORY_SIZE];
+} analysis_t;
+
+static_assert(MEMORY_SIZE / ANALYZE_PAGE_SIZE <=
+              sizeof(((analysis_t *)0)->written_pages) * UINT8_WIDTH);
+
+// follows every jump, call and skip from `entry` through big endian code in
+// `memory` (MEMORY_SIZE bytes). blocks are sorted by start address
+extern void analyze(const uint8_t *memory, address_t entry, analysis_t *a);
+
+#endif
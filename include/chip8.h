@@ -0,0 +1,104 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+// embeddable emulator, libchip8. every machine owns its memory and any number
+// of them can be driven from one thread. needs nothing but libc
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHIP8_WIDTH (64)
+#define CHIP8_HEIGHT (32)
+#define CHIP8_PITCH (CHIP8_WIDTH / 8)
+#define CHIP8_PROGRAM_START (0x200)
+
+// one bit per pixel, most significant bit is the leftmost pixel
+typedef uint8_t chip8_row_t[CHIP8_PITCH];
+typedef struct chip8 chip8_t;
+
+typedef struct {
+  uint8_t v[16];
+  uint16_t i;
+  uint16_t pc;
+  uint16_t sp; // next free slot, the stack grows down from 0xED0
+  uint8_t delay;
+  uint8_t sound;
+} chip8_registers_t;
+
+// breakpoint condition on one register, V[reg] op value
+typedef enum {
+  CHIP8_COND_ALWAYS,
+  CHIP8_COND_EQ,
+  CHIP8_COND_NE,
+  CHIP8_COND_LT,
+  CHIP8_COND_GT,
+} chip8_cond_op_t;
+
+typedef struct {
+  chip8_cond_op_t op;
+  uint8_t reg;
+  uint8_t value;
+} chip8_cond_t;
+
+typedef enum {
+  CHIP8_STOP_NONE,
+  CHIP8_STOP_BREAKPOINT,
+  CHIP8_STOP_WATCHPOINT, // FX33 or FX55 about to write watched memory
+} chip8_stop_t;
+
+// `ips` of 0 runs as fast as frame budget allows. returns nullptr if out of
+// memory
+extern chip8_t *chip8_create(uint16_t ips);
+extern void chip8_destroy(chip8_t *m);
+// power cycles the machine and copies `size` bytes of `rom` to `start`.
+// returns -1 if it is empty or does not fit before the stack
+extern int chip8_load(chip8_t *m, const uint8_t *rom, size_t size,
+                      uint16_t start);
+// makes `dst` an exact copy of `src`, memory, registers and rng included.
+// a machine kept aside this way is a snapshot. both share 256 byte pages of
+// memory until one of them writes a page, so only the screen is copied
+extern void chip8_copy(chip8_t *dst, const chip8_t *src);
+// reseeds the random number generator of CXNN. machines are seeded the same by
+// chip8_load
+extern void chip8_seed(chip8_t *m, uint32_t seed);
+// runs `n` instructions, timers are not ticked. returns -1 once PC leaves
+// program memory, 1 if a breakpoint or watchpoint stopped it
+extern int chip8_step(chip8_t *m, uint32_t n);
+// runs instructions due in one 1/60 s frame and ticks timers once. returns -1
+// once PC leaves program memory, 1 if a breakpoint or watchpoint stopped it
+// before the instruction at PC. the next call finishes that frame, running
+// the instruction it stopped at
+extern int chip8_run_frame(chip8_t *m);
+// bit n set - key n is held
+extern void chip8_set_keys(chip8_t *m, uint16_t keys);
+// CHIP8_HEIGHT rows, points into the machine and stays valid until
+// chip8_destroy
+extern const chip8_row_t *chip8_framebuffer(const chip8_t *m);
+// true once after every change of the framebuffer
+extern bool chip8_redraw(chip8_t *m);
+// byte of guest memory at `address` % 4096
+extern uint8_t chip8_peek(const chip8_t *m, uint16_t address);
+// instructions run since chip8_load, idle loop iterations skipped included
+extern uint64_t chip8_retired(const chip8_t *m);
+// DXYN executed since chip8_load, wraps
+extern uint32_t chip8_draws(const chip8_t *m);
+// sound timer is running
+extern bool chip8_sound(const chip8_t *m);
+extern void chip8_registers(const chip8_t *m, chip8_registers_t *r);
+// stops before the instruction at `address` runs while `cond` holds, nullptr
+// always. breakpoints and watchpoints are patched into the decoded code, a
+// machine without any runs at full speed. returns -1 if too many are set
+extern int chip8_break(chip8_t *m, uint16_t address, const chip8_cond_t *cond);
+// stops before FX33 or FX55 writes any of `size` bytes from `address`
+extern int chip8_watch(chip8_t *m, uint16_t address, uint16_t size);
+// remove every breakpoint or watchpoint at `address`, -1 if there was none
+extern int chip8_unbreak(chip8_t *m, uint16_t address);
+extern int chip8_unwatch(chip8_t *m, uint16_t address);
+// why the last run or step returned 1, `where` gets the address of the
+// breakpoint or watchpoint. CHIP8_STOP_NONE once it runs on
+extern chip8_stop_t chip8_stopped(const chip8_t *m, uint16_t *where);
+// hash of everything the future of the machine depends on: memory, screen
+// included, registers, timers and rng. held keys are input and left out
+extern uint64_t chip8_hash(const chip8_t *m);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+// debugger on a UNIX socket, one client at a time sending lines of text.
+// numbers are hex:
+//   b ADDR [vX==NN]  break at ADDR, while the condition holds if given. != <
+//                    and > compare too
+//   db ADDR          deletes breakpoints at ADDR
+//   w ADDR [SIZE]    stops FX33 and FX55 writing SIZE bytes from ADDR
+//   dw ADDR          deletes watchpoints at ADDR
+//   c                continues
+//   p                pauses
+//   s [N]            steps N instructions, timers are not ticked. long steps
+//                    are spread over frames, p or c cancels them
+//   r                registers
+//   x ADDR [LEN]     memory, LEN is 16 unless given
+// every command is answered by a line starting with "ok" or "error". every
+// time the machine stops, a line starting with "stop" tells where and why.
+// breakpoints cost nothing until they are set, see chip8_break
+#include "chip8.h"
+
+// listens on UNIX socket at `path`, the machine starts paused. returns -1 on
+// failure
+extern int debugger_init(const char *path);
+extern void debugger_exit(void);
+// serves the client, then runs a frame unless paused. returns what
+// chip8_run_frame does, except breakpoints pause and return 0. without
+// debugger_init it is chip8_run_frame
+extern int debugger_frame(chip8_t *m);
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "instructions.h"
+#include "state.h"
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGISTER_FROM(value, nibble)                                           \
+  (enum gp_registers_t)(((value) & (0xF << ((nibble) * (CHAR_BIT / 2)))) >>    \
+                        ((nibble) * (CHAR_BIT / 2)))
+#define VALUE_FROM(value) ((value) & 0xFF)
+#define ADDRESS_FROM(value) ((address_t){(value) & 0xFFF})
+
+typedef enum : uint8_t {
+  OP_INVALID,
+  OP_CLS,       // 00E0
+  OP_RET,       // 00EE
+  OP_JP,        // 1NNN
+  OP_CALL,      // 2NNN
+  OP_SE_NN,     // 3XNN
+  OP_SNE_NN,    // 4XNN
+  OP_SE_VY,     // 5XY0
+  OP_LD_NN,     // 6XNN
+  OP_ADD_NN,    // 7XNN
+  OP_LD_VY,     // 8XY0
+  OP_OR,        // 8XY1
+  OP_AND,       // 8XY2
+  OP_XOR,       // 8XY3
+  OP_ADD_VY,    // 8XY4
+  OP_SUB,       // 8XY5
+  OP_SHR,       // 8XY6
+  OP_SUBN,      // 8XY7
+  OP_SHL,       // 8XYE
+  OP_SNE_VY,    // 9XY0
+  OP_LD_I,      // ANNN
+  OP_JP_V0,     // BNNN
+  OP_RND,       // CXNN
+  OP_DRW,       // DXYN
+  OP_SKP,       // EX9E
+  OP_SKNP,      // EXA1
+  OP_LD_VX_DT,  // FX07
+  OP_LD_K,      // FX0A
+  OP_LD_DT,     // FX15
+  OP_LD_ST,     // FX18
+  OP_ADD_I,     // FX1E
+  OP_LD_F,      // FX29
+  OP_LD_B,      // FX33
+  OP_LD_I_VX,   // FX55
+  OP_LD_VX_I,   // FX65
+  OP_COUNT,
+} opcode_t;
+
+// what an instruction does to PC, for static analysis
+typedef enum : uint8_t {
+  FLOW_NEXT,     // falls through
+  FLOW_SKIP,     // falls through or skips next instruction
+  FLOW_JUMP,     // to NNN
+  FLOW_CALL,     // to NNN, comes back to next instruction
+  FLOW_RET,      // to top of the stack
+  FLOW_INDIRECT, // to NNN + V0
+  FLOW_STOP,     // invalid instruction
+} flow_t;
+
+// which bits of the instruction are operands, for disassembly
+typedef enum : uint8_t {
+  OPERANDS_NONE,
+  OPERANDS_X,
+  OPERANDS_XY,
+  OPERANDS_XNN,
+  OPERANDS_XYN,
+  OPERANDS_NNN,
+} operands_t;
+
+typedef struct {
+  const char *format; // printf format taking the operands in order
+  operands_t operands;
+  flow_t flow;
+} opcode_info_t;
+
+extern const opcode_info_t OPCODES[OP_COUNT];
+
+#define DECODE_MAX_FUSED (4)
+
+// common sequences run by one handler
+typedef enum : uint8_t {
+  SUPER_NONE,
+  SUPER_LD_I_DRW,   // ANNN DXYN, sprite setup and draw
+  SUPER_LD_NN_RUN,  // 6XNN 6XNN..., register loads
+  SUPER_COUNT_LOOP, // 7XNN 3XNN|4XNN 1NNN on the same X, counter loop
+  SUPER_LD_I_LOAD,  // ANNN FX65, table load
+  SUPER_TRAP,       // breakpoint or watched store, see trap.h
+} super_t;
+
+// predecoded code at one address. every address has its own entry, so a jump
+// into the middle of a sequence runs the entry of that address
+struct decoded {
+  uint8_t count; // instructions in `words` run by `super`, 0 - not decoded
+  opcode_t op;   // of words[0]
+  super_t super;
+  instruction_t words[DECODE_MAX_FUSED]; // native byte order
+};
+typedef struct decoded decoded_t;
+
+// entry for PC from STATE.cache, decoded on first use. PC must be below
+// AVALIABLE_MEMORY_END
+extern const decoded_t *decode_fetch(pc_t pc);
+// drops every entry, after memory was replaced
+extern void decode_flush(void);
+// drops entries which read any of `size` bytes from `a`
+extern void decode_invalidate(address_t a, uint32_t size);
+
+// writes disassembly of `i` to `buf`, returns snprintf result
+extern int decode_format(instruction_t i, char *buf, size_t size);
+
+inline opcode_t decode(instruction_t i) {
+  switch (i >> 12) {
+  case 0x0:
+    if (i == 0x00E0)
+      return OP_CLS;
+    if (i == 0x00EE)
+      return OP_RET;
+    return OP_INVALID;
+  case 0x1:
+    return OP_JP;
+  case 0x2:
+    return OP_CALL;
+  case 0x3:
+    return OP_SE_NN;
+  case 0x4:
+    return OP_SNE_NN;
+  case 0x5:
+    return (i & 0xF) == 0 ? OP_SE_VY : OP_INVALID;
+  case 0x6:
+    return OP_LD_NN;
+  case 0x7:
+    return OP_ADD_NN;
+  case 0x8:
+    switch (i & 0xF) {
+    case 0x0:
+      return OP_LD_VY;
+    case 0x1:
+      return OP_OR;
+    case 0x2:
+      return OP_AND;
+    case 0x3:
+      return OP_XOR;
+    case 0x4:
+      return OP_ADD_VY;
+    case 0x5:
+      return OP_SUB;
+    case 0x6:
+      return OP_SHR;
+    case 0x7:
+      return OP_SUBN;
+    case 0xE:
+      return OP_SHL;
+    default:
+      return OP_INVALID;
+    }
+  case 0x9:
+    return (i & 0xF) == 0 ? OP_SNE_VY : OP_INVALID;
+  case 0xA:
+    return OP_LD_I;
+  case 0xB:
+    return OP_JP_V0;
+  case 0xC:
+    return OP_RND;
+  case 0xD:
+    return OP_DRW;
+  case 0xE:
+    switch (i & 0xFF) {
+    case 0x9E:
+      return OP_SKP;
+    case 0xA1:
+      return OP_SKNP;
+    default:
+      return OP_INVALID;
+    }
+  default: // 0xF
+    switch (i & 0xFF) {
+    case 0x07:
+      return OP_LD_VX_DT;
+    case 0x0A:
+      return OP_LD_K;
+    case 0x15:
+      return OP_LD_DT;
+    case 0x18:
+      return OP_LD_ST;
+    case 0x1E:
+      return OP_ADD_I;
+    case 0x29:
+      return OP_LD_F;
+    case 0x33:
+      return OP_LD_B;
+    case 0x55:
+      return OP_LD_I_VX;
+    case 0x65:
+      return OP_LD_VX_I;
+    default:
+      return OP_INVALID;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef ENV_H
+#define ENV_H
+
+// batch of machines running the same ROM for training agents. every step
+// runs all of them on a thread pool and gathers observations and rewards into
+// flat arrays
+#include "chip8.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ENV_MAX_REWARDS (8)
+
+typedef struct {
+  const uint8_t *rom;
+  size_t rom_size;
+  uint16_t start; // 0 - CHIP8_PROGRAM_START
+  uint16_t ips;
+  uint32_t frames_per_step; // actions are held this long, 0 - 1
+  uint32_t warmup_frames;   // run once after loading, episodes start there
+  uint32_t max_frames;      // episodes are cut after that many, 0 - never
+  // reward is how much bytes at these addresses went up during the step
+  uint16_t rewards[ENV_MAX_REWARDS];
+  uint32_t rewards_count;
+  uint32_t threads; // 0 - one per online cpu
+  uint32_t seed;    // every episode of every machine draws different numbers
+} env_config_t;
+
+typedef struct env env_t;
+
+// observation of one machine, row y is framebuffer row y with bit 63 as the
+// leftmost pixel
+typedef uint64_t env_observation_t[CHIP8_HEIGHT];
+
+// returns nullptr if ROM does not load or out of memory
+extern env_t *env_create(uint32_t count, const env_config_t *c);
+extern void env_destroy(env_t *e);
+// restarts every machine from the episode start. `obs` has one observation
+// per machine
+extern void env_reset(env_t *e, env_observation_t *obs);
+// holds keys `actions[i]` on machine i for a step. a machine whose episode
+// ended gets `dones[i]` set and is already reset, so its observation is the
+// first one of the next episode
+extern void env_step(env_t *e, const uint16_t *actions, env_observation_t *obs,
+                     int32_t *rewards, bool *dones);
+
+#endif
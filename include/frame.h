@@ -0,0 +1,17 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+
+#define FRAMES_PER_SECOND (60)
+
+// runs instructions due in one 1/60 s frame and ticks timers once.
+// loops which can not change anything before the next tick are skipped over
+// whole iterations at a time. returns -1 once PC leaves program memory, 1 if
+// a trap stopped it, the next call runs the rest of the frame
+extern int frame_run(void);
+// runs `n` instructions one by one, timers are not ticked. returns -1 once PC
+// leaves program memory, 1 if a trap stopped it
+extern int frame_step(uint32_t n);
+
+#endif
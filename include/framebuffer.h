@@ -0,0 +1,26 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "periph.h"
+#include "state.h"
+#include <stdint.h>
+
+// one bit per pixel, most significant bit is the leftmost pixel
+#define FRAMEBUFFER_PITCH (WIDTH / UINT8_WIDTH)
+
+typedef uint8_t framebuffer_row_t[FRAMEBUFFER_PITCH];
+
+static_assert(sizeof(STATE.mmap->display_refresh) ==
+              HEIGHT * FRAMEBUFFER_PITCH);
+
+extern void framebuffer_clear(void);
+// xors sprite in at (x, y). start position wraps, sprite is clipped at the
+// edges. returns true if any pixel was turned off
+extern bool framebuffer_draw(uint32_t y, uint32_t x, sprite_t s);
+
+// framebuffer lives in 0xF00 - 0xFFF like on the original interpreter
+inline const framebuffer_row_t *framebuffer_pointer(void) {
+  return (const framebuffer_row_t *)STATE.mmap->display_refresh;
+}
+
+#endif
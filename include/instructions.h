@@ -4,6 +4,16 @@
 #include <stdint.h>
 typedef uint16_t instruction_t;
 #define INSTRUCTION_SIZE sizeof(instruction_t)
+// instructions are stored big endian
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BSWAP16(x) __builtin_bswap16((x))
+#else
+#define BSWAP16(x) (x)
+#endif
 extern int execute(instruction_t i);
+// runs the entry of STATE.cache at PC, a whole fused sequence if at most
+// `left` instructions. returns how many instructions ran, 0 if a trap stopped
+// before the one at PC
+extern uint32_t execute_cached(uint32_t left);
 
 #endif
@@ -0,0 +1,49 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// bucket n holds samples in [2^n, 2^(n+1)) microseconds, first one
+// everything below 2 us and last one everything above
+#define METRICS_BUCKETS (20)
+#define METRICS_STATUS_SIZE (160)
+
+typedef struct {
+  uint32_t counts[METRICS_BUCKETS];
+  uint32_t total;
+  uint64_t sum_us; // buckets are coarse, mean is not
+} histogram_t;
+
+// frontend loop timings, gathered per one second window
+typedef struct {
+  uint32_t ips_target; // what `-i` asked for, instructions per second
+  uint32_t ips;        // achieved in the window
+  uint32_t frames;
+  double draws_per_frame;
+  histogram_t frame_time; // from one wakeup to the next
+  histogram_t oversleep;  // wakeup past the deadline
+  // from the wakeup a new key press was seen at to the end of the frame it
+  // was run in. the render thread polls the terminal once per frame and the
+  // keys are read at the next wakeup, so add up to two frames for the time
+  // the press waited to be seen
+  histogram_t key_latency;
+} metrics_t;
+
+// `path` gets a new stats file every second, may be nullptr. returns -1 if
+// it is too long
+extern int metrics_init(uint32_t ips_target, const char *path);
+// right after the frame sleep, `deadline` is what it slept until
+extern void metrics_wake(const struct timespec *deadline);
+// keys read for the frame about to run
+extern void metrics_keys(uint16_t keys);
+// frame ran and was handed to the render thread
+extern void metrics_frame_done(void);
+// once a second closes the window with totals of the machine, writes the
+// stats file and fills `status` with a one line summary. returns false
+// if the window is not over yet
+extern bool metrics_publish(uint64_t retired, uint32_t draws, char *status,
+                            size_t size);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+// STATE_PAGE_SIZE bytes of guest memory shared between machines. a copied
+// machine shares all pages of the original, the first write to a shared page
+// gets a private copy of it. pages never change while shared
+#include "state.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define PAGE_ZERO_ID (1)    // id of every page holding only zeros
+#define PAGE_INTERNED (256) // slots of page_intern
+
+typedef struct {
+  atomic_uint refs;
+  uint64_t id; // new whenever the bytes change, equal ids mean equal bytes
+  uint8_t bytes[STATE_PAGE_SIZE];
+} page_t;
+
+// page holding `bytes`, one reference taken. nullptr if out of memory
+extern page_t *page_new(const uint8_t *bytes);
+// the zeroed page shared by all, one reference taken. it is never freed
+extern page_t *page_zero(void);
+// like page_new, but the same bytes interned before give the same page. for
+// pages of freshly loaded programs, font and ROM are shared across loads
+extern page_t *page_intern(const uint8_t *bytes);
+extern page_t *page_share(page_t *p);
+extern void page_release(page_t *p);
+// `bytes` stored into the reference `p`, in place unless it is shared.
+// returns the page holding them, nullptr and `p` untouched if out of memory
+extern page_t *page_write(page_t *p, const uint8_t *bytes);
+
+#endif
@@ -43,14 +43,24 @@ typedef enum : uint16_t {
   CHIP_KEY_NONE = UINT16_MAX,
 } keys_t;
 
+typedef enum : uint8_t {
+  RENDERER_ASCII,      // 1x1 pixels per cell, 64x32 cells
+  RENDERER_HALF_BLOCK, // 1x2 pixels per cell, 64x16 cells
+  RENDERER_BRAILLE,    // 2x4 pixels per cell, 32x8 cells
+} renderer_t;
+
 typedef struct _win_st WINDOW;
 
-extern int display_init(void);
+extern int display_init(renderer_t r);
 extern void display_exit(void);
-extern void display_clear(void);
-extern bool display_draw(uint32_t y, uint32_t x, sprite_t s);
+// `fb` is HEIGHT rows of WIDTH / 8 bytes. only cells that changed since
+// previous call are written to the terminal, an unchanged frame costs no
+// refresh
+extern void display_present(const uint8_t (*fb)[WIDTH / UINT8_WIDTH]);
+// one line under the screen, dropped if the terminal has no room for it
+extern void display_status(const char *text);
 extern void sound_beep(void);
-extern keys_t keyboard_get_key_nonblocking(void);
-extern keys_t keyboard_get_key_blocking(void);
+// drains pending input, call once per frame. bit n set - key n is held
+extern uint16_t keyboard_poll(void);
 
 #endif
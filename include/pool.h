@@ -0,0 +1,17 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+typedef struct pool pool_t;
+typedef void (*pool_fn_t)(void *ctx, uint32_t index);
+
+// `threads` counts the caller of pool_run, 0 means one per online cpu.
+// returns nullptr on failure
+extern pool_t *pool_create(uint32_t threads);
+extern void pool_destroy(pool_t *p);
+// calls `fn(ctx, i)` for every i in [0, count) spread over the threads and
+// returns once all calls did. calls for the same i never overlap
+extern void pool_run(pool_t *p, uint32_t count, pool_fn_t fn, void *ctx);
+
+#endif
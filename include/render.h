@@ -0,0 +1,25 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+// terminal frontend on a thread of its own. it owns curses output, keyboard
+// input, the bell and spectators, so a slow terminal never holds up the
+// emulation thread. frames are handed over through a triple buffer and only
+// the newest one is presented, the ones in between are dropped
+#include "framebuffer.h"
+#include "periph.h"
+#include <stdint.h>
+
+// terminal and stream must be set up already, the render thread takes them
+// over. returns -1 if the thread does not start
+extern int render_start(void);
+// joins the render thread, the caller may use the terminal again. does
+// nothing if it was not started
+extern void render_stop(void);
+// hands a finished frame over, never blocks or makes a syscall. `status`
+// replaces the status line, nullptr keeps the previous one
+extern void render_publish(const framebuffer_row_t *fb, bool sound,
+                           const char *status);
+// keys the render thread polled last, bit n set - key n is held
+extern uint16_t render_keys(void);
+
+#endif
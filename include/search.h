@@ -0,0 +1,55 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// beam search over key inputs for playtesting and route finding. every round
+// each state of the beam is forked once per key set, the children run on a
+// thread pool, and the best ones not seen before make the next beam
+#include "chip8.h"
+#include <stdint.h>
+
+#define SEARCH_MAX_TERMS (8)
+#define SEARCH_MAX_ACTIONS (64)
+
+// adds `weight` times the byte at `address` to the score. a 16 bit big endian
+// counter is two terms with weights 256 and 1, negative weights minimize
+typedef struct {
+  uint16_t address;
+  int32_t weight;
+} search_term_t;
+
+typedef struct {
+  uint32_t width;  // states kept every round
+  uint32_t frames; // key sets are held this long, 0 - 1
+  // key sets every state is forked into, bit n - key n is held. with none
+  // given a state is forked into no keys and every single key
+  uint16_t actions[SEARCH_MAX_ACTIONS];
+  uint32_t actions_count;
+  search_term_t objective[SEARCH_MAX_TERMS];
+  uint32_t objective_count;
+  uint32_t threads; // 0 - one per online cpu
+} search_config_t;
+
+typedef struct search search_t;
+
+// `start` is copied, the beam starts with it alone. width * key sets machines
+// are allocated, so memory grows with both. returns nullptr if out of memory
+extern search_t *search_create(const chip8_t *start, const search_config_t *c);
+extern void search_destroy(search_t *s);
+// forks, runs and scores one round. returns states in the new beam, 0 once
+// every branch stopped or only led to states seen before. the beam is kept
+// as it was then
+extern uint32_t search_round(search_t *s);
+// states in the beam, best first. `rank` below search_width
+extern uint32_t search_width(const search_t *s);
+extern const chip8_t *search_state(const search_t *s, uint32_t rank);
+extern int64_t search_score(const search_t *s, uint32_t rank);
+// key sets held every round on the way to `rank`, first round first. writes
+// at most `max` and returns how many rounds it took
+extern uint32_t search_route(const search_t *s, uint32_t rank, uint16_t *keys,
+                             uint32_t max);
+// distinct states kept so far
+extern uint64_t search_visited(const search_t *s);
+// children run so far, duplicates and stopped ones included
+extern uint64_t search_explored(const search_t *s);
+
+#endif
@@ -12,6 +12,11 @@
 #define MAX_NEST (12)
 #define PROGRAM_START (0x200)
 #define DEFAULT_IPS (100)
+// what `ips` of 0 means
+#define IPS_UNLIMITED (1'000'000)
+#define RNG_SEED (69) // nice
+#define DECODE_CACHE (MEMORY_SIZE) // one entry per address, odd ones included
+#define STATE_PAGE_SIZE (256)      // granularity of STATE.dirty
 
 // gp - general purpose
 typedef uint8_t gp_register_value_t;
@@ -85,17 +90,58 @@ typedef struct {
     uint8_t _stack[96];           // 0xEA0 - 0xEFF internal use
     uint8_t display_refresh[256]; // 0xF00 - 0xFFF self-explanatory
   } *mmap;
+  // DECODE_CACHE entries predecoded from mmap, see decode.h. nullptr runs
+  // execute() straight from memory
+  struct decoded *cache;
+  // breakpoints and watchpoints, see trap.h. nullptr if none are set
+  struct traps *traps;
 
   instructions_per_second_t ips;
   uint8_t nest;
-  const uint8_t __padding[5];
+  bool redraw;         // framebuffer changed since last present
+  uint16_t keys;       // bit n set - key n is held
+  uint8_t key_wait;    // key + 1 FX0A waits to be released, 0 if none
+  uint8_t cycles_rest; // remainder of ips / 60 carried to next frame
+  uint32_t frame_left; // of a frame a trap stopped, run before the next one
+  // bumped by every instruction writing memory, screen or using rand
+  uint32_t effects;
+  uint32_t rng;     // xorshift32 state for CXNN, never 0
+  uint32_t draws;   // DXYN executed, wraps
+  uint64_t retired; // instructions run, idle iterations skipped included
+  // bit n set - page n (address / STATE_PAGE_SIZE) was written, screen and
+  // stack included. cleared for every call of chip8.h, which stores those
+  // pages back to the machine
+  uint16_t dirty;
 } state_t;
 
-extern state_t STATE;
+static_assert(MEMORY_SIZE / STATE_PAGE_SIZE <=
+              sizeof(((state_t *)0)->dirty) * UINT8_WIDTH);
+
+// initial-exec keeps thread locals as cheap as plain globals, but takes
+// static TLS which a dlopen()ed library may not get. objects of libchip8.so
+// are built with STATE_TLS_DYNAMIC and keep the default model
+#ifdef STATE_TLS_DYNAMIC
+#define STATE_TLS
+#else
+#define STATE_TLS [[gnu::tls_model("initial-exec")]]
+#endif
+
+// every thread runs its own machine
+extern thread_local state_t STATE STATE_TLS;
 typedef struct _IO_FILE FILE;
-extern int state_init(instructions_per_second_t ips, address_t program_start, FILE *prog);
-// clears registers, stack. resets base sprites and sets PC to value of
-// `program_start`. All memory modifications preserved. (except stack)
+// zeroed guest memory for STATE.mmap. it is followed by a mirror of itself,
+// so sprites and FX33/FX55/FX65 running past 0xFFF wrap to 0x000 like on
+// hardware. where pages are bigger than guest memory a PROT_NONE page follows
+// instead and running past the end faults. neither costs a bounds check.
+// either way it takes two mappings out of vm.max_map_count, chip8.h takes
+// one such memory per thread and none per machine. returns nullptr on failure
+extern void *state_memory_alloc(void);
+extern void state_memory_free(void *memory);
+// reads whole `prog` to PC. fails if it does not fit before the stack
+extern int state_load_program(FILE *prog);
+// clears registers, stack, keys and reseeds rng. resets base sprites and sets
+// PC to value of `program_start`. All memory modifications preserved. (except
+// stack)
 extern void state_reset(instructions_per_second_t ips, address_t program_start);
 // modifies STATE.registers.SP
 extern address_t state_sp_ld(void);
@@ -110,4 +156,11 @@ inline gp_register_value_t *state_register_value(enum gp_registers_t type) {
   return (gp_register_value_t *)&STATE.registers + type;
 }
 
+// marks [a, a + size) dirty. writes are at most 16 bytes, so they span two
+// pages at most, the second one wraps past 0xFFF like the memory does
+inline void state_memory_dirty(address_t a, uint32_t size) {
+  STATE.dirty |= 1 << a.v / STATE_PAGE_SIZE |
+                 1 << (a.v + size - 1) % MEMORY_SIZE / STATE_PAGE_SIZE;
+}
+
 #endif
@@ -0,0 +1,28 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "framebuffer.h"
+#include <stdint.h>
+
+#define STREAM_MAGIC (0x38504843) // "CHP8"
+#define STREAM_MAX_CLIENTS (64)
+
+// every message is a header followed by one FRAMEBUFFER_PITCH sized xor
+// delta for each bit set in `rows`, lowest row first. first message a
+// client gets is the whole screen as a delta against a blank one.
+typedef struct {
+  uint32_t magic;
+  uint32_t frame;
+  uint32_t rows; // bit n set - row n changed
+} stream_header_t;
+
+static_assert(HEIGHT <= sizeof(((stream_header_t *)0)->rows) * UINT8_WIDTH);
+
+// listens on UNIX socket at `path`. returns -1 on failure
+extern int stream_init(const char *path);
+extern void stream_exit(void);
+// accepts pending spectators and sends them changes since previous call.
+// never blocks, spectators which can not keep up are dropped
+extern void stream_publish(const framebuffer_row_t *fb);
+
+#endif
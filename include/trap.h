@@ -0,0 +1,47 @@
+#ifndef TRAP_H
+#define TRAP_H
+
+// breakpoints and watchpoints. nothing checks for them while running, the
+// entries of STATE.cache they concern decode as SUPER_TRAP instead and only
+// those ask trap_hit. without STATE.traps the core runs as if there was no
+// debugger at all
+#include "chip8.h"
+#include "decode.h"
+#include "state.h"
+#include <stdint.h>
+
+#define TRAP_MAX_BREAKPOINTS (32)
+#define TRAP_MAX_WATCHPOINTS (8)
+
+typedef struct {
+  uint16_t address;
+  chip8_cond_t cond;
+} breakpoint_t;
+
+typedef struct {
+  uint16_t address;
+  uint16_t size;
+} watchpoint_t;
+
+struct traps {
+  uint32_t breakpoints_count;
+  breakpoint_t breakpoints[TRAP_MAX_BREAKPOINTS];
+  uint32_t watchpoints_count;
+  watchpoint_t watchpoints[TRAP_MAX_WATCHPOINTS];
+  bool resume;         // the trap at resume_pc was reported, run it once
+  uint16_t resume_pc;
+  chip8_stop_t stop;   // why the last run stopped
+  uint16_t stop_where; // address of the breakpoint or watchpoint
+  uint64_t id;         // new for every change of the traps, never 0
+};
+typedef struct traps traps_t;
+
+// whether the entry decoded for `op` at `pc` must be a trap
+extern bool trap_at(uint16_t pc, opcode_t op);
+// `d` at `pc` is about to run. returns true and records why if it must stop
+// before it does
+extern bool trap_hit(const decoded_t *d, uint16_t pc);
+// next run goes on from a reported stop
+extern void trap_resume(void);
+
+#endif
@@ -0,0 +1,236 @@
+#include "analyze.h"
+#include "decode.h"
+#include "utils.h"
+#include <string.h>
+
+// lattice for I: not reached yet, one constant or anything
+#define I_UNSET (UINT16_MAX - 1)
+#define I_UNKNOWN (UINT16_MAX)
+
+static inline instruction_t fetch(const uint8_t *memory, uint16_t pc) {
+  return memory[pc] << 8 | memory[(pc + 1) % MEMORY_SIZE];
+}
+
+// execution stops once PC leaves program memory, see frame_run
+static inline uint16_t successor(uint32_t pc) {
+  return pc < AVALIABLE_MEMORY_END ? pc : ANALYZE_NONE;
+}
+
+// successor which turned out to be a valid instruction
+static inline uint16_t code_successor(const analysis_t *a, uint32_t pc) {
+  uint16_t next = successor(pc);
+  return next != ANALYZE_NONE && a->map[next] == BYTE_CODE ? next
+                                                           : ANALYZE_NONE;
+}
+
+static void data_mark(analysis_t *a, uint16_t i, uint32_t size) {
+  for (uint32_t b = i; b < i + size && b < MEMORY_SIZE; b++) {
+    if (a->map[b] == BYTE_UNKNOWN)
+      a->map[b] = BYTE_DATA;
+  }
+}
+
+static void store_mark(analysis_t *a, uint16_t i, uint32_t size) {
+  if (i == I_UNKNOWN) {
+    a->written_unknown = true;
+    return;
+  }
+  data_mark(a, i, size);
+  for (uint32_t b = i; b < i + size && b < AVALIABLE_MEMORY_END; b++)
+    a->written_pages |= 1 << (b / ANALYZE_PAGE_SIZE);
+}
+
+// finds every reachable instruction and marks where blocks start
+static void discover(const uint8_t *memory, analysis_t *a, bool *leader) {
+  uint16_t stack[2 * MEMORY_SIZE]; // every instruction pushes at most two
+  uint32_t top = 0;
+  bool seen[MEMORY_SIZE] = {};
+
+  leader[a->entry.v] = true;
+  stack[top++] = a->entry.v;
+  while (top != 0) {
+    uint16_t pc = stack[--top];
+    if (seen[pc])
+      continue;
+    seen[pc] = true;
+
+    instruction_t i = fetch(memory, pc);
+    const opcode_info_t *info = &OPCODES[decode(i)];
+    if (info->flow == FLOW_STOP)
+      continue;
+    a->map[pc] = BYTE_CODE;
+    if (a->map[(pc + 1) % MEMORY_SIZE] != BYTE_CODE) // overlapping code
+      a->map[(pc + 1) % MEMORY_SIZE] = BYTE_OPERAND;
+
+    uint16_t next[2] = {ANALYZE_NONE, ANALYZE_NONE};
+    switch (info->flow) {
+    case FLOW_NEXT:
+      next[0] = successor(pc + INSTRUCTION_SIZE);
+      break;
+    case FLOW_SKIP:
+      next[0] = successor(pc + INSTRUCTION_SIZE);
+      next[1] = successor(pc + 2 * INSTRUCTION_SIZE);
+      break;
+    case FLOW_CALL:
+      next[1] = successor(pc + INSTRUCTION_SIZE);
+      [[fallthrough]];
+    case FLOW_JUMP:
+      next[0] = successor(ADDRESS_FROM(i).v);
+      break;
+    case FLOW_INDIRECT:
+      a->indirect = true;
+      break;
+    case FLOW_RET:
+    case FLOW_STOP:
+      break;
+    }
+
+    for (uint32_t n = 0; n < ARRAY_SIZE(next); n++) {
+      if (next[n] == ANALYZE_NONE)
+        continue;
+      // anything but falling through to the next instruction starts a block
+      if (info->flow != FLOW_NEXT)
+        leader[next[n]] = true;
+      stack[top++] = next[n];
+    }
+  }
+}
+
+// splits reachable code at leaders
+static void block_build(const uint8_t *memory, analysis_t *a,
+                        const bool *leader, uint16_t start) {
+  block_t *b = &a->blocks[a->blocks_count];
+  *b = (block_t){start, start, {ANALYZE_NONE, ANALYZE_NONE}, FLOW_STOP};
+
+  for (uint16_t pc = start;; pc += INSTRUCTION_SIZE) {
+    instruction_t i = fetch(memory, pc);
+    b->flow = OPCODES[decode(i)].flow;
+    if (b->flow == FLOW_STOP)
+      break;
+    b->end = pc + INSTRUCTION_SIZE;
+
+    switch (b->flow) {
+    case FLOW_NEXT: {
+      uint16_t next = code_successor(a, pc + INSTRUCTION_SIZE);
+      if (next != ANALYZE_NONE && !leader[next])
+        continue;
+      b->next[0] = next;
+      break;
+    }
+    case FLOW_SKIP:
+      b->next[0] = code_successor(a, pc + INSTRUCTION_SIZE);
+      b->next[1] = code_successor(a, pc + 2 * INSTRUCTION_SIZE);
+      break;
+    case FLOW_CALL:
+      b->next[1] = code_successor(a, pc + INSTRUCTION_SIZE);
+      [[fallthrough]];
+    case FLOW_JUMP:
+      b->next[0] = code_successor(a, ADDRESS_FROM(i).v);
+      break;
+    case FLOW_INDIRECT:
+    case FLOW_RET:
+    case FLOW_STOP:
+      break;
+    }
+    break;
+  }
+
+  if (b->end != b->start)
+    a->blocks_count++;
+}
+
+// I through the block, starting with `I`. with `mark` finds sprites, tables
+// and stores
+static uint16_t block_walk(const uint8_t *memory, analysis_t *a,
+                           const block_t *b, uint16_t I, bool mark) {
+  for (uint16_t pc = b->start; pc != b->end; pc += INSTRUCTION_SIZE) {
+    instruction_t i = fetch(memory, pc);
+    uint32_t x = REGISTER_FROM(i, 2);
+    switch (decode(i)) {
+    case OP_LD_I:
+      I = ADDRESS_FROM(i).v;
+      break;
+    case OP_ADD_I:
+    case OP_LD_F:
+      I = I_UNKNOWN;
+      break;
+    case OP_DRW:
+      if (mark && I != I_UNKNOWN)
+        data_mark(a, I, i & 0xF);
+      break;
+    case OP_LD_VX_I:
+      if (mark && I != I_UNKNOWN)
+        data_mark(a, I, x + 1);
+      I = I == I_UNKNOWN ? I_UNKNOWN : (I + x + 1) % MEMORY_SIZE;
+      break;
+    case OP_LD_I_VX:
+      if (mark)
+        store_mark(a, I, x + 1);
+      I = I == I_UNKNOWN ? I_UNKNOWN : (I + x + 1) % MEMORY_SIZE;
+      break;
+    case OP_LD_B:
+      if (mark)
+        store_mark(a, I, 3);
+      break;
+    default:
+      break;
+    }
+  }
+  return I;
+}
+
+static inline uint16_t I_meet(uint16_t a, uint16_t b) {
+  if (a == I_UNSET)
+    return b;
+  return a == b || b == I_UNSET ? a : I_UNKNOWN;
+}
+
+// value of I on entry to each block, constant if every path agrees on it
+static void I_propagate(const uint8_t *memory, analysis_t *a, uint16_t *in) {
+  uint16_t block_of[MEMORY_SIZE];
+  for (uint32_t b = 0; b < a->blocks_count; b++) {
+    block_of[a->blocks[b].start] = b;
+    in[b] = I_UNSET;
+  }
+  if (a->blocks_count == 0)
+    return;
+  in[block_of[a->entry.v]] = 0; // reset clears I
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t b = 0; b < a->blocks_count; b++) {
+      const block_t *block = &a->blocks[b];
+      if (in[b] == I_UNSET)
+        continue;
+      uint16_t out = block_walk(memory, a, block, in[b], false);
+      for (uint32_t n = 0; n < ARRAY_SIZE(block->next); n++) {
+        if (block->next[n] == ANALYZE_NONE)
+          continue;
+        // subroutine may change I before coming back
+        bool ret = block->flow == FLOW_CALL && n == 1;
+        uint16_t *next_in = &in[block_of[block->next[n]]];
+        uint16_t met = I_meet(*next_in, ret ? I_UNKNOWN : out);
+        changed |= met != *next_in;
+        *next_in = met;
+      }
+    }
+  }
+}
+
+void analyze(const uint8_t *memory, address_t entry, analysis_t *a) {
+  memset(a, 0, sizeof(*a));
+  a->entry = entry;
+
+  bool leader[MEMORY_SIZE] = {};
+  discover(memory, a, leader);
+  for (uint16_t pc = 0; pc < MEMORY_SIZE; pc++) {
+    if (leader[pc])
+      block_build(memory, a, leader, pc);
+  }
+
+  uint16_t in[ARRAY_SIZE(a->blocks)];
+  I_propagate(memory, a, in);
+  for (uint32_t b = 0; b < a->blocks_count; b++)
+    block_walk(memory, a, &a->blocks[b], in[b], true);
+}
@@ -0,0 +1,444 @@
+#include "chip8.h"
+#include "analyze.h"
+#include "decode.h"
+#include "frame.h"
+#include "framebuffer.h"
+#include "log.h"
+#include "page.h"
+#include "state.h"
+#include "trap.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(CHIP8_WIDTH == WIDTH && CHIP8_HEIGHT == HEIGHT);
+static_assert(sizeof(chip8_row_t) == sizeof(framebuffer_row_t));
+static_assert(CHIP8_PROGRAM_START == PROGRAM_START);
+
+#define PAGES (MEMORY_SIZE / STATE_PAGE_SIZE)
+#define DISPLAY_PAGE                                                           \
+  (offsetof(typeof(*STATE.mmap), display_refresh) / STATE_PAGE_SIZE)
+static_assert(offsetof(typeof(*STATE.mmap), display_refresh) %
+                      STATE_PAGE_SIZE ==
+                  0 &&
+              sizeof(STATE.mmap->display_refresh) == STATE_PAGE_SIZE);
+
+struct chip8 {
+  state_t state; // state.mmap and state.cache are nullptr, memory is in pages
+  page_t *pages[PAGES];
+  uint64_t ids[PAGES]; // of pages, entering reads no page it does not copy
+  // never shared, so chip8_framebuffer can point into it for good
+  page_t display;
+};
+
+// machines own no mappings and no decode cache, so chip8_create makes no
+// syscalls and a copy shares all of its memory. every thread runs machines in
+// guest memory of its own instead, see state_memory_alloc, with one cache
+// decoded from it. pages whose ids differ from what is there are copied in
+typedef struct {
+  void *memory;
+  decoded_t *cache;
+  uint64_t pages[PAGES]; // ids of the pages in memory, 0 for none
+  uint64_t traps;        // id of the traps cache decoded with, 0 for none
+} thread_memory_t;
+
+static thread_local thread_memory_t THREAD STATE_TLS = {};
+// frees THREAD when the thread exits
+static pthread_key_t THREAD_KEY;
+static pthread_once_t THREAD_ONCE = PTHREAD_ONCE_INIT;
+// 0 is never handed out, it stands for no traps
+static atomic_uint_fast64_t TRAPS_IDS = 1;
+
+static void thread_memory_free(void *arg) {
+  thread_memory_t *t = arg;
+  state_memory_free(t->memory);
+  free(t->cache);
+  *t = (thread_memory_t){};
+}
+
+static void thread_key_create(void) {
+  pthread_key_create(&THREAD_KEY, thread_memory_free);
+}
+
+static int thread_memory_init(void) {
+  THREAD.memory = state_memory_alloc();
+  THREAD.cache = calloc(DECODE_CACHE, sizeof(*THREAD.cache));
+  EXPECT(THREAD.memory != nullptr && THREAD.cache != nullptr, ({
+           LOG_ERROR("Failed to allocate guest memory of the thread, "
+                     "vm.max_map_count may be used up");
+           thread_memory_free(&THREAD);
+           return -1;
+         }));
+  for (uint32_t p = 0; p < PAGES; p++)
+    THREAD.pages[p] = PAGE_ZERO_ID;
+  pthread_once(&THREAD_ONCE, thread_key_create);
+  pthread_setspecific(THREAD_KEY, &THREAD);
+  return 0;
+}
+
+// copies page `p` into the memory of the thread. machines running the same
+// program mostly differ in data, so entries are dropped only where words do
+static inline void page_enter(uint32_t p, const page_t *page) {
+  uint8_t *memory = (uint8_t *)STATE.mmap + p * STATE_PAGE_SIZE;
+  THREAD.pages[p] = page->id;
+  if (memcmp(memory, page->bytes, STATE_PAGE_SIZE) == 0)
+    return;
+  for (uint32_t b = 0; b < STATE_PAGE_SIZE; b += sizeof(uint64_t)) {
+    uint64_t old, new;
+    memcpy(&old, memory + b, sizeof(old));
+    memcpy(&new, page->bytes + b, sizeof(new));
+    if (old == new)
+      continue;
+    memcpy(memory + b, &new, sizeof(new));
+    decode_invalidate((address_t){p * STATE_PAGE_SIZE + b}, sizeof(new));
+  }
+}
+
+// the core works on STATE, a machine is swapped in for every call. pages are
+// copied in unless the thread has them already, which it does for the machine
+// it ran last and for most of the pages of its copies. returns -1 if the
+// thread has no memory
+static inline int machine_enter(const chip8_t *m) {
+  if (THREAD.memory == nullptr && thread_memory_init() == -1)
+    return -1;
+  memcpy(&STATE, &m->state, sizeof(STATE));
+  STATE.mmap = THREAD.memory;
+  STATE.cache = THREAD.cache;
+
+  uint64_t traps = STATE.traps != nullptr ? STATE.traps->id : 0;
+  if (THREAD.traps != traps) { // trap entries decode differently
+    decode_flush();
+    THREAD.traps = traps;
+  }
+  for (uint32_t p = 0; p < PAGES; p++) {
+    if (THREAD.pages[p] != m->ids[p])
+      page_enter(p, m->pages[p]);
+  }
+  STATE.dirty = 0; // pages of this call only
+  return 0;
+}
+
+// pages written during the call are stored back, shared ones are copied
+// first. returns -1 if out of memory, those pages keep what they had then
+static inline int machine_leave(chip8_t *m) {
+  int res = 0;
+  for (uint32_t p = 0; STATE.dirty >> p != 0; p++) {
+    if (!(STATE.dirty & 1 << p))
+      continue;
+    page_t *page = page_write(
+        m->pages[p], (const uint8_t *)STATE.mmap + p * STATE_PAGE_SIZE);
+    if (page != nullptr) {
+      m->pages[p] = page;
+      m->ids[p] = page->id;
+    } else {
+      res = -1;
+    }
+    THREAD.pages[p] = page != nullptr ? page->id : 0;
+  }
+  STATE.mmap = nullptr;
+  STATE.cache = nullptr;
+  memcpy(&m->state, &STATE, sizeof(STATE));
+  EXPECT(res != -1, LOG_ERROR("Failed to store guest memory"));
+  return res;
+}
+
+// stores all of memory after chip8_create or chip8_load, nothing is left for
+// machine_leave. returns -1 if out of memory
+static int pages_store(chip8_t *m) {
+  STATE.dirty = 0;
+  memset(THREAD.pages, 0, sizeof(THREAD.pages));
+  for (uint32_t p = 0; p < PAGES; p++) {
+    const uint8_t *bytes = (const uint8_t *)STATE.mmap + p * STATE_PAGE_SIZE;
+    page_t *page = p == DISPLAY_PAGE ? page_write(m->pages[p], bytes)
+                                     : page_intern(bytes);
+    if (page == nullptr)
+      return -1;
+    if (p != DISPLAY_PAGE)
+      page_release(m->pages[p]);
+    m->pages[p] = page;
+    m->ids[p] = page->id;
+    THREAD.pages[p] = page->id;
+  }
+  return 0;
+}
+
+// decodes code reachable from PC into the cache of the thread, so the first
+// frames do not. pages the program stores to are left for first use, their
+// code may change before it runs. only a head start, nothing if out of memory
+static void code_predecode(void) {
+  analysis_t *a = malloc(sizeof(*a));
+  if (a == nullptr)
+    return;
+  analyze((const uint8_t *)STATE.mmap, STATE.registers.PC, a);
+  uint16_t written = a->written_unknown ? UINT16_MAX : a->written_pages;
+  for (uint32_t b = 0; b < AVALIABLE_MEMORY_END; b++) {
+    if (a->map[b] == BYTE_CODE && !(written & 1 << b / ANALYZE_PAGE_SIZE))
+      decode_fetch((pc_t){b});
+  }
+  free(a);
+}
+
+chip8_t *chip8_create(uint16_t ips) {
+  chip8_t *m = calloc(1, sizeof(*m));
+  if (m == nullptr)
+    return nullptr;
+  atomic_init(&m->display.refs, 1);
+  m->display.id = PAGE_ZERO_ID;
+  for (uint32_t p = 0; p < PAGES; p++) {
+    m->pages[p] = p == DISPLAY_PAGE ? &m->display : page_zero();
+    m->ids[p] = PAGE_ZERO_ID;
+  }
+  if (machine_enter(m) == -1) {
+    chip8_destroy(m);
+    return nullptr;
+  }
+  state_reset(ips, (address_t){PROGRAM_START});
+  int res = pages_store(m);
+  machine_leave(m);
+  if (res == -1) {
+    chip8_destroy(m);
+    return nullptr;
+  }
+  return m;
+}
+
+void chip8_destroy(chip8_t *m) {
+  if (m == nullptr)
+    return;
+  for (uint32_t p = 0; p < PAGES; p++) {
+    if (m->pages[p] != nullptr && m->pages[p] != &m->display)
+      page_release(m->pages[p]);
+  }
+  free(m->state.traps);
+  free(m);
+}
+
+int chip8_load(chip8_t *m, const uint8_t *rom, size_t size, uint16_t start) {
+  // fmemopen does not take empty buffers
+  if (size == 0 || start >= AVALIABLE_MEMORY_END)
+    return -1;
+
+  if (machine_enter(m) == -1)
+    return -1;
+  memset(STATE.mmap, 0, MEMORY_SIZE);
+  state_reset(STATE.ips, (address_t){start});
+  STATE.effects = 0;
+  STATE.draws = 0;
+  STATE.retired = 0;
+  STATE.redraw = true;
+  if (STATE.traps != nullptr) { // breakpoints stay for the new program
+    STATE.traps->stop = CHIP8_STOP_NONE;
+    STATE.traps->resume = false;
+  }
+
+  int res = -1;
+  FILE *prog = fmemopen((void *)rom, size, "rb");
+  if (prog != nullptr) {
+    res = state_load_program(prog);
+    fclose(prog);
+  }
+  if (res != -1)
+    code_predecode();
+  if (pages_store(m) == -1)
+    res = -1;
+  machine_leave(m);
+  EXPECT(res != -1, LOG_ERROR("Failed to load program of %zu bytes", size));
+  return res;
+}
+
+void chip8_copy(chip8_t *dst, const chip8_t *src) {
+  if (dst == src)
+    return;
+  for (uint32_t p = 0; p < PAGES; p++) {
+    if (p == DISPLAY_PAGE || dst->pages[p] == src->pages[p])
+      continue;
+    page_release(dst->pages[p]);
+    dst->pages[p] = page_share(src->pages[p]);
+  }
+  if (dst->display.id != src->display.id) { // same id, same bytes
+    memcpy(dst->display.bytes, src->display.bytes, STATE_PAGE_SIZE);
+    dst->display.id = src->display.id;
+  }
+  memcpy(dst->ids, src->ids, sizeof(dst->ids));
+
+  struct traps *traps = dst->state.traps;
+  dst->state = src->state;
+  dst->state.traps = traps;
+  if (traps != nullptr) { // a stop of dst says nothing about the copied PC
+    traps->stop = CHIP8_STOP_NONE;
+    traps->resume = false;
+  }
+}
+
+void chip8_seed(chip8_t *m, uint32_t seed) {
+  m->state.rng = seed != 0 ? seed : RNG_SEED; // xorshift is stuck at 0
+}
+
+int chip8_step(chip8_t *m, uint32_t n) {
+  if (machine_enter(m) == -1)
+    return -1;
+  if (STATE.traps != nullptr)
+    trap_resume();
+  int res = frame_step(n);
+  return machine_leave(m) == -1 ? -1 : res;
+}
+
+int chip8_run_frame(chip8_t *m) {
+  if (machine_enter(m) == -1)
+    return -1;
+  if (STATE.traps != nullptr)
+    trap_resume();
+  int res = frame_run();
+  return machine_leave(m) == -1 ? -1 : res;
+}
+
+void chip8_set_keys(chip8_t *m, uint16_t keys) { m->state.keys = keys; }
+
+const chip8_row_t *chip8_framebuffer(const chip8_t *m) {
+  return (const chip8_row_t *)m->display.bytes;
+}
+
+bool chip8_redraw(chip8_t *m) {
+  bool redraw = m->state.redraw;
+  m->state.redraw = false;
+  return redraw;
+}
+
+uint8_t chip8_peek(const chip8_t *m, uint16_t address) {
+  address %= MEMORY_SIZE;
+  return m->pages[address / STATE_PAGE_SIZE]->bytes[address % STATE_PAGE_SIZE];
+}
+
+uint64_t chip8_retired(const chip8_t *m) { return m->state.retired; }
+
+uint32_t chip8_draws(const chip8_t *m) { return m->state.draws; }
+
+bool chip8_sound(const chip8_t *m) { return m->state.timers.sound != 0; }
+
+void chip8_registers(const chip8_t *m, chip8_registers_t *r) {
+  const state_t *s = &m->state;
+  static_assert(sizeof(r->v) == offsetof(typeof(s->registers), VF) + 1);
+  memcpy(r->v, &s->registers, sizeof(r->v));
+  r->i = s->registers.I.v;
+  r->pc = s->registers.PC.v;
+  r->sp = s->registers.SP.v;
+  r->delay = s->timers.delay;
+  r->sound = s->timers.sound;
+}
+
+static traps_t *traps_get(chip8_t *m) {
+  if (m->state.traps == nullptr) {
+    m->state.traps = calloc(1, sizeof(*m->state.traps));
+    if (m->state.traps != nullptr)
+      m->state.traps->id =
+          atomic_fetch_add_explicit(&TRAPS_IDS, 1, memory_order_relaxed);
+  }
+  return m->state.traps;
+}
+
+// a new id makes the next run decode again with the new set of traps, see
+// machine_enter. without any left the machine goes back to running without
+// traps at all
+static void traps_changed(chip8_t *m) {
+  traps_t *t = m->state.traps;
+  if (t->breakpoints_count == 0 && t->watchpoints_count == 0) {
+    free(t);
+    m->state.traps = nullptr;
+    return;
+  }
+  t->id = atomic_fetch_add_explicit(&TRAPS_IDS, 1, memory_order_relaxed);
+}
+
+int chip8_break(chip8_t *m, uint16_t address, const chip8_cond_t *cond) {
+  traps_t *t = traps_get(m);
+  if (t == nullptr || t->breakpoints_count == TRAP_MAX_BREAKPOINTS)
+    return -1;
+  address %= MEMORY_SIZE;
+  t->breakpoints[t->breakpoints_count++] = (breakpoint_t){
+      address, cond ? *cond : (chip8_cond_t){CHIP8_COND_ALWAYS, 0, 0}};
+  traps_changed(m);
+  return 0;
+}
+
+int chip8_watch(chip8_t *m, uint16_t address, uint16_t size) {
+  traps_t *t = traps_get(m);
+  if (t == nullptr || t->watchpoints_count == TRAP_MAX_WATCHPOINTS ||
+      size == 0)
+    return -1;
+  address %= MEMORY_SIZE;
+  t->watchpoints[t->watchpoints_count++] = (watchpoint_t){address, size};
+  traps_changed(m);
+  return 0;
+}
+
+int chip8_unbreak(chip8_t *m, uint16_t address) {
+  traps_t *t = m->state.traps;
+  if (t == nullptr)
+    return -1;
+  uint32_t kept = 0;
+  for (uint32_t b = 0; b < t->breakpoints_count; b++) {
+    if (t->breakpoints[b].address != address % MEMORY_SIZE)
+      t->breakpoints[kept++] = t->breakpoints[b];
+  }
+  bool found = kept != t->breakpoints_count;
+  t->breakpoints_count = kept;
+  traps_changed(m);
+  return found ? 0 : -1;
+}
+
+int chip8_unwatch(chip8_t *m, uint16_t address) {
+  traps_t *t = m->state.traps;
+  if (t == nullptr)
+    return -1;
+  uint32_t kept = 0;
+  for (uint32_t w = 0; w < t->watchpoints_count; w++) {
+    if (t->watchpoints[w].address != address % MEMORY_SIZE)
+      t->watchpoints[kept++] = t->watchpoints[w];
+  }
+  bool found = kept != t->watchpoints_count;
+  t->watchpoints_count = kept;
+  traps_changed(m);
+  return found ? 0 : -1;
+}
+
+chip8_stop_t chip8_stopped(const chip8_t *m, uint16_t *where) {
+  const traps_t *t = m->state.traps;
+  if (t == nullptr || t->stop == CHIP8_STOP_NONE)
+    return CHIP8_STOP_NONE;
+  if (where != nullptr)
+    *where = t->stop_where;
+  return t->stop;
+}
+
+// word at a time, the whole memory is hashed for every explored state
+static inline uint64_t hash_mix(uint64_t h, uint64_t v) {
+  h = (h ^ v) * 0x9E3779B97F4A7C15;
+  return h ^ h >> 29;
+}
+
+uint64_t chip8_hash(const chip8_t *m) {
+  const state_t *s = &m->state;
+  uint64_t h = 0xcbf29ce484222325;
+  for (uint32_t p = 0; p < PAGES; p++) {
+    for (uint32_t b = 0; b < STATE_PAGE_SIZE; b += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, m->pages[p]->bytes + b, sizeof(word));
+      h = hash_mix(h, word);
+    }
+  }
+  // field by field, bit-fields and padding may hold anything
+  uint64_t v[2];
+  static_assert(offsetof(typeof(s->registers), VF) == sizeof(v) - 1);
+  memcpy(v, &s->registers, sizeof(v));
+  h = hash_mix(h, v[0]);
+  h = hash_mix(h, v[1]);
+  h = hash_mix(h, (uint64_t)s->registers.I.v << 48 |
+                      (uint64_t)s->registers.PC.v << 32 |
+                      s->registers.SP.v << 16 | s->nest);
+  return hash_mix(h, (uint64_t)s->rng << 32 |
+                        (uint32_t)s->timers.delay << 24 |
+                        s->timers.sound << 16 | s->key_wait << 8 |
+                        s->cycles_rest);
+}
@@ -0,0 +1,320 @@
+#include "debugger.h"
+#include "decode.h"
+#include "frame.h"
+#include "log.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define LINE_SIZE (128)
+#define DUMP_DEFAULT (16)
+#define DUMP_MAX (256)
+// `s N` runs at most a full speed frame of its instructions per frame, so
+// it can not freeze the emulator and `p` stops it
+#define STEPS_PER_FRAME (IPS_UNLIMITED / FRAMES_PER_SECOND)
+// longest reply is a whole dump, 3 characters a byte after its address
+#define REPLY_SIZE (LINE_SIZE + DUMP_MAX * 3)
+
+static int LISTENER = -1;
+static int CLIENT = -1;
+static char LINE[LINE_SIZE]; // received, not yet a whole line
+static uint32_t LINE_LENGTH = 0;
+static bool PAUSED = true;
+static uint32_t STEPS = 0; // left of the running `s N`
+static char PATH[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+int debugger_init(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  EXPECT(strlen(path) < sizeof(addr.sun_path), ({
+           LOG_ERROR("socket path is too long: %s", path);
+           return -1;
+         }));
+  strcpy(addr.sun_path, path);
+
+  LISTENER = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  EXPECT(LISTENER != -1, ({
+           LOG_ERROR("socket failed: %s", strerror(errno));
+           return -1;
+         }));
+
+  unlink(path); // stale socket from previous run
+  EXPECT(bind(LISTENER, (struct sockaddr *)&addr, sizeof(addr)) != -1 &&
+             listen(LISTENER, 1) != -1,
+         ({
+           LOG_ERROR("failed to listen on %s: %s", path, strerror(errno));
+           close(LISTENER);
+           LISTENER = -1;
+           return -1;
+         }));
+
+  strcpy(PATH, path);
+  PAUSED = true;
+  LOG_INFO("debugger on %s", path);
+  return 0;
+}
+
+static void client_drop(void) {
+  LOG_INFO("debugger client %d gone", CLIENT);
+  close(CLIENT);
+  CLIENT = -1;
+}
+
+void debugger_exit(void) {
+  if (LISTENER == -1)
+    return;
+  if (CLIENT != -1)
+    client_drop();
+  close(LISTENER);
+  LISTENER = -1;
+  unlink(PATH);
+}
+
+// one line to the client, which is dropped if it does not take all of it
+[[gnu::format(printf, 1, 2)]] static void reply(const char *format, ...) {
+  if (CLIENT == -1)
+    return;
+  char text[REPLY_SIZE];
+  va_list args;
+  va_start(args, format);
+  int size = vsnprintf(text, sizeof(text) - 1, format, args);
+  va_end(args);
+  size = size < (int)sizeof(text) - 1 ? size : (int)sizeof(text) - 2;
+  text[size++] = '\n';
+  if (send(CLIENT, text, size, MSG_DONTWAIT | MSG_NOSIGNAL) != size)
+    client_drop();
+}
+
+static uint16_t pc_get(const chip8_t *m) {
+  chip8_registers_t r;
+  chip8_registers(m, &r);
+  return r.pc;
+}
+
+static void stop_report(const chip8_t *m, const char *why, uint16_t where) {
+  uint16_t pc = pc_get(m);
+  char text[32];
+  decode_format(chip8_peek(m, pc) << 8 | chip8_peek(m, pc + 1), text,
+                sizeof(text));
+  reply("stop %s %03x pc %03x: %s", why, where, pc, text);
+}
+
+// what run or step returned 1 for
+static void trap_report(const chip8_t *m) {
+  uint16_t where = 0;
+  chip8_stop_t stop = chip8_stopped(m, &where);
+  stop_report(m, stop == CHIP8_STOP_WATCHPOINT ? "watchpoint" : "breakpoint",
+              where);
+}
+
+// hex with or without 0x, up to `max`
+static bool hex_parse(const char *str, uint32_t max, uint32_t *v) {
+  if (str == nullptr)
+    return false;
+  char *end = nullptr;
+  unsigned long res = strtoul(str, &end, 16);
+  if (*str == '\0' || *end != '\0' || res > max)
+    return false;
+  *v = res;
+  return true;
+}
+
+// vX==NN, vX!=NN, vX<NN or vX>NN
+static bool cond_parse(const char *str, chip8_cond_t *c) {
+  static const struct {
+    const char *text;
+    chip8_cond_op_t op;
+  } OPS[] = {{"==", CHIP8_COND_EQ},
+             {"!=", CHIP8_COND_NE},
+             {"<", CHIP8_COND_LT},
+             {">", CHIP8_COND_GT}};
+  uint32_t reg, value;
+  char name[2] = {};
+  if (str[0] != 'v' && str[0] != 'V')
+    return false;
+  name[0] = str[1];
+  if (!hex_parse(name, 0xF, &reg))
+    return false;
+  for (uint32_t i = 0; i < ARRAY_SIZE(OPS); i++) {
+    size_t length = strlen(OPS[i].text);
+    if (strncmp(str + 2, OPS[i].text, length) != 0)
+      continue;
+    if (!hex_parse(str + 2 + length, UINT8_MAX, &value))
+      return false;
+    *c = (chip8_cond_t){OPS[i].op, reg, value};
+    return true;
+  }
+  return false;
+}
+
+static void registers_reply(const chip8_t *m) {
+  chip8_registers_t r;
+  chip8_registers(m, &r);
+  char v[16 * 3 + 1];
+  for (uint32_t x = 0; x < 16; x++)
+    snprintf(v + x * 3, sizeof(v) - x * 3, " %02x", r.v[x]);
+  reply("ok pc %03x i %03x sp %03x dt %02x st %02x v%s", r.pc, r.i, r.sp,
+        r.delay, r.sound, v);
+}
+
+static void memory_reply(const chip8_t *m, uint32_t address,
+                         uint32_t length) {
+  char bytes[DUMP_MAX * 3 + 1] = "";
+  for (uint32_t b = 0; b < length; b++)
+    snprintf(bytes + b * 3, sizeof(bytes) - b * 3, " %02x",
+             chip8_peek(m, (address + b) % MEMORY_SIZE));
+  reply("ok %03x%s", address, bytes);
+}
+
+// next part of the running `s N`, reports where it ended once it did. returns
+// -1 if it ran the program out of memory
+static int steps_run(chip8_t *m) {
+  uint32_t n = STEPS < STEPS_PER_FRAME ? STEPS : STEPS_PER_FRAME;
+  STEPS -= n;
+  int res = chip8_step(m, n);
+  if (res != 0)
+    STEPS = 0;
+  if (res == 1)
+    trap_report(m);
+  else if (res == -1 || STEPS == 0)
+    stop_report(m, res == -1 ? "exit" : "step", pc_get(m));
+  return res == -1 ? -1 : 0;
+}
+
+// runs one command. returns -1 if a step ran the program out of memory
+static int command_run(chip8_t *m, char *line) {
+  char *save = nullptr;
+  const char *cmd = strtok_r(line, " \t\r", &save);
+  const char *arg1 = strtok_r(nullptr, " \t\r", &save);
+  const char *arg2 = strtok_r(nullptr, " \t\r", &save);
+  uint32_t a, b;
+  if (cmd == nullptr)
+    return 0;
+
+  if (strcmp(cmd, "b") == 0 && hex_parse(arg1, MEMORY_SIZE - 1, &a)) {
+    chip8_cond_t c;
+    if (arg2 != nullptr && !cond_parse(arg2, &c))
+      reply("error bad condition %s", arg2);
+    else if (chip8_break(m, a, arg2 ? &c : nullptr) == -1)
+      reply("error too many breakpoints");
+    else
+      reply("ok");
+  } else if (strcmp(cmd, "db") == 0 && hex_parse(arg1, MEMORY_SIZE - 1, &a)) {
+    reply(chip8_unbreak(m, a) == -1 ? "error no breakpoint" : "ok");
+  } else if (strcmp(cmd, "w") == 0 && hex_parse(arg1, MEMORY_SIZE - 1, &a)) {
+    b = 1;
+    if (arg2 != nullptr && (!hex_parse(arg2, MEMORY_SIZE, &b) || b == 0))
+      reply("error bad size %s", arg2);
+    else if (chip8_watch(m, a, b) == -1)
+      reply("error too many watchpoints");
+    else
+      reply("ok");
+  } else if (strcmp(cmd, "dw") == 0 && hex_parse(arg1, MEMORY_SIZE - 1, &a)) {
+    reply(chip8_unwatch(m, a) == -1 ? "error no watchpoint" : "ok");
+  } else if (strcmp(cmd, "c") == 0) {
+    PAUSED = false;
+    STEPS = 0;
+    reply("ok");
+  } else if (strcmp(cmd, "p") == 0) {
+    reply("ok");
+    if (!PAUSED || STEPS != 0)
+      stop_report(m, "pause", pc_get(m));
+    PAUSED = true;
+    STEPS = 0;
+  } else if (strcmp(cmd, "s") == 0) {
+    b = 1;
+    if (arg1 != nullptr && (!hex_parse(arg1, UINT32_MAX, &b) || b == 0)) {
+      reply("error bad count %s", arg1);
+      return 0;
+    }
+    reply("ok");
+    PAUSED = true;
+    STEPS = b;
+    return steps_run(m);
+  } else if (strcmp(cmd, "r") == 0) {
+    registers_reply(m);
+  } else if (strcmp(cmd, "x") == 0 && hex_parse(arg1, MEMORY_SIZE - 1, &a)) {
+    b = DUMP_DEFAULT;
+    if (arg2 != nullptr && !hex_parse(arg2, DUMP_MAX, &b))
+      reply("error bad length %s", arg2);
+    else
+      memory_reply(m, a, b);
+  } else {
+    reply("error bad command %s", cmd);
+  }
+  return 0;
+}
+
+static void client_accept(void) {
+  int fd;
+  while ((fd = accept(LISTENER, nullptr, nullptr)) != -1) {
+    if (CLIENT != -1) {
+      LOG_WARN("refusing debugger client %d", fd);
+      close(fd);
+      continue;
+    }
+    LOG_INFO("debugger client %d", fd);
+    CLIENT = fd;
+    LINE_LENGTH = 0;
+  }
+}
+
+// commands received since the previous frame. returns -1 if one of them
+// ran the program out of memory
+static int client_serve(chip8_t *m) {
+  while (CLIENT != -1) {
+    ssize_t got = recv(CLIENT, LINE + LINE_LENGTH,
+                       sizeof(LINE) - 1 - LINE_LENGTH, MSG_DONTWAIT);
+    if (got == 0 || (got == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      client_drop();
+      return 0;
+    }
+    if (got == -1)
+      return 0;
+    LINE_LENGTH += got;
+
+    char *start = LINE, *newline;
+    while ((newline = memchr(start, '\n', LINE + LINE_LENGTH - start))) {
+      *newline = '\0';
+      if (command_run(m, start) == -1)
+        return -1;
+      if (CLIENT == -1)
+        return 0;
+      start = newline + 1;
+    }
+    LINE_LENGTH -= start - LINE;
+    memmove(LINE, start, LINE_LENGTH);
+    if (LINE_LENGTH == sizeof(LINE) - 1) {
+      reply("error line too long");
+      LINE_LENGTH = 0;
+    }
+  }
+  return 0;
+}
+
+int debugger_frame(chip8_t *m) {
+  if (LISTENER == -1)
+    return chip8_run_frame(m);
+
+  client_accept();
+  if (client_serve(m) == -1)
+    return -1;
+  if (STEPS != 0)
+    return steps_run(m);
+  if (PAUSED)
+    return 0;
+
+  int res = chip8_run_frame(m);
+  if (res == 1) {
+    PAUSED = true;
+    trap_report(m);
+    return 0;
+  }
+  if (res == -1)
+    stop_report(m, "exit", pc_get(m));
+  return res;
+}
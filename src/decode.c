@@ -0,0 +1,149 @@
+#include "decode.h"
+#include "trap.h"
+#include <stdio.h>
+#include <string.h>
+
+extern inline opcode_t decode(instruction_t i);
+
+const opcode_info_t OPCODES[OP_COUNT] = {
+    [OP_INVALID] = {"DW 0x%04X", OPERANDS_NONE, FLOW_STOP},
+    [OP_CLS] = {"CLS", OPERANDS_NONE, FLOW_NEXT},
+    [OP_RET] = {"RET", OPERANDS_NONE, FLOW_RET},
+    [OP_JP] = {"JP 0x%03X", OPERANDS_NNN, FLOW_JUMP},
+    [OP_CALL] = {"CALL 0x%03X", OPERANDS_NNN, FLOW_CALL},
+    [OP_SE_NN] = {"SE V%X, 0x%02X", OPERANDS_XNN, FLOW_SKIP},
+    [OP_SNE_NN] = {"SNE V%X, 0x%02X", OPERANDS_XNN, FLOW_SKIP},
+    [OP_SE_VY] = {"SE V%X, V%X", OPERANDS_XY, FLOW_SKIP},
+    [OP_LD_NN] = {"LD V%X, 0x%02X", OPERANDS_XNN, FLOW_NEXT},
+    [OP_ADD_NN] = {"ADD V%X, 0x%02X", OPERANDS_XNN, FLOW_NEXT},
+    [OP_LD_VY] = {"LD V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_OR] = {"OR V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_AND] = {"AND V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_XOR] = {"XOR V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_ADD_VY] = {"ADD V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_SUB] = {"SUB V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_SHR] = {"SHR V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_SUBN] = {"SUBN V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_SHL] = {"SHL V%X, V%X", OPERANDS_XY, FLOW_NEXT},
+    [OP_SNE_VY] = {"SNE V%X, V%X", OPERANDS_XY, FLOW_SKIP},
+    [OP_LD_I] = {"LD I, 0x%03X", OPERANDS_NNN, FLOW_NEXT},
+    [OP_JP_V0] = {"JP V0, 0x%03X", OPERANDS_NNN, FLOW_INDIRECT},
+    [OP_RND] = {"RND V%X, 0x%02X", OPERANDS_XNN, FLOW_NEXT},
+    [OP_DRW] = {"DRW V%X, V%X, %u", OPERANDS_XYN, FLOW_NEXT},
+    [OP_SKP] = {"SKP V%X", OPERANDS_X, FLOW_SKIP},
+    [OP_SKNP] = {"SKNP V%X", OPERANDS_X, FLOW_SKIP},
+    [OP_LD_VX_DT] = {"LD V%X, DT", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_K] = {"LD V%X, K", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_DT] = {"LD DT, V%X", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_ST] = {"LD ST, V%X", OPERANDS_X, FLOW_NEXT},
+    [OP_ADD_I] = {"ADD I, V%X", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_F] = {"LD F, V%X", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_B] = {"LD B, V%X", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_I_VX] = {"LD [I], V%X", OPERANDS_X, FLOW_NEXT},
+    [OP_LD_VX_I] = {"LD V%X, [I]", OPERANDS_X, FLOW_NEXT},
+};
+
+int decode_format(instruction_t i, char *buf, size_t size) {
+  const opcode_info_t *info = &OPCODES[decode(i)];
+  uint32_t x = REGISTER_FROM(i, 2);
+  uint32_t y = REGISTER_FROM(i, 1);
+
+  switch (info->operands) {
+  case OPERANDS_NONE:
+    return snprintf(buf, size, info->format, i); // only DW uses `i`
+  case OPERANDS_X:
+    return snprintf(buf, size, info->format, x);
+  case OPERANDS_XY:
+    return snprintf(buf, size, info->format, x, y);
+  case OPERANDS_XNN:
+    return snprintf(buf, size, info->format, x, VALUE_FROM(i));
+  case OPERANDS_XYN:
+    return snprintf(buf, size, info->format, x, y, i & 0xF);
+  case OPERANDS_NNN:
+    return snprintf(buf, size, info->format, ADDRESS_FROM(i).v);
+  }
+  return -1;
+}
+
+static inline instruction_t fetch(uint16_t pc) {
+  const uint8_t *memory = (const uint8_t *)STATE.mmap;
+  return memory[pc] << 8 | memory[pc + 1];
+}
+
+static void decode_fill(decoded_t *d, uint16_t pc) {
+  // execution stops at the stack, so does fusing
+  uint32_t max = (AVALIABLE_MEMORY_END - 1 - pc) / INSTRUCTION_SIZE + 1;
+  max = max < DECODE_MAX_FUSED ? max : DECODE_MAX_FUSED;
+  opcode_t ops[DECODE_MAX_FUSED] = {};
+  for (uint32_t k = 0; k < max; k++) {
+    d->words[k] = fetch(pc + k * INSTRUCTION_SIZE);
+    ops[k] = decode(d->words[k]);
+  }
+  d->op = ops[0];
+  d->super = SUPER_NONE;
+  d->count = 1;
+
+  switch (d->op) {
+  case OP_LD_I:
+    if (ops[1] == OP_DRW || ops[1] == OP_LD_VX_I) {
+      d->super = ops[1] == OP_DRW ? SUPER_LD_I_DRW : SUPER_LD_I_LOAD;
+      d->count = 2;
+    }
+    break;
+  case OP_LD_NN: {
+    uint32_t n = 1;
+    while (n < max && ops[n] == OP_LD_NN)
+      n++;
+    if (n > 1) {
+      d->super = SUPER_LD_NN_RUN;
+      d->count = n;
+    }
+    break;
+  }
+  case OP_ADD_NN:
+    if ((ops[1] == OP_SE_NN || ops[1] == OP_SNE_NN) && ops[2] == OP_JP &&
+        REGISTER_FROM(d->words[0], 2) == REGISTER_FROM(d->words[1], 2)) {
+      d->super = SUPER_COUNT_LOOP;
+      d->count = 3;
+    }
+    break;
+  default:
+    break;
+  }
+
+  if (STATE.traps == nullptr)
+    return;
+  // a fused sequence would run over a trap inside it
+  for (uint32_t k = 1; k < d->count; k++) {
+    if (trap_at(pc + k * INSTRUCTION_SIZE, ops[k])) {
+      d->super = SUPER_NONE;
+      d->count = 1;
+    }
+  }
+  if (trap_at(pc, d->op)) {
+    d->super = SUPER_TRAP;
+    d->count = 1;
+  }
+}
+
+const decoded_t *decode_fetch(pc_t pc) {
+  decoded_t *d = &STATE.cache[pc.v];
+  if (d->count == 0)
+    decode_fill(d, pc.v);
+  return d;
+}
+
+void decode_flush(void) {
+  if (STATE.cache != nullptr)
+    memset(STATE.cache, 0, DECODE_CACHE * sizeof(*STATE.cache));
+}
+
+void decode_invalidate(address_t a, uint32_t size) {
+  if (STATE.cache == nullptr)
+    return;
+  // an entry reads up to DECODE_MAX_FUSED instructions from its address
+  uint32_t reach = DECODE_MAX_FUSED * INSTRUCTION_SIZE - 1;
+  for (uint32_t b = a.v + MEMORY_SIZE - reach; b < a.v + MEMORY_SIZE + size;
+       b++)
+    STATE.cache[b % MEMORY_SIZE].count = 0;
+}
@@ -0,0 +1,142 @@
+#include "env.h"
+#include "chip8.h"
+#include "log.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BSWAP64(x) __builtin_bswap64((x))
+#else
+#define BSWAP64(x) (x)
+#endif
+
+typedef struct {
+  chip8_t *m;
+  uint32_t frames;   // into the episode
+  uint32_t episodes; // started so far, part of the seed
+  uint8_t last[ENV_MAX_REWARDS];
+} machine_t;
+
+struct env {
+  env_config_t config;
+  chip8_t *start; // snapshot every episode starts from
+  pool_t *pool;
+
+  // arguments of the running step
+  const uint16_t *actions;
+  env_observation_t *obs;
+  int32_t *rewards;
+  bool *dones;
+
+  uint32_t count;
+  machine_t machines[];
+};
+
+static void machine_observe(const machine_t *machine, env_observation_t obs) {
+  const chip8_row_t *fb = chip8_framebuffer(machine->m);
+  for (uint32_t y = 0; y < CHIP8_HEIGHT; y++) {
+    uint64_t row;
+    memcpy(&row, fb[y], sizeof(row));
+    obs[y] = BSWAP64(row);
+  }
+}
+
+static void machine_reset(env_t *e, uint32_t index) {
+  machine_t *machine = &e->machines[index];
+  chip8_copy(machine->m, e->start);
+  // golden ratio spreads machines and episodes over the seed space
+  chip8_seed(machine->m, e->config.seed + index * 0x9E3779B9 +
+                             machine->episodes++ * 0x85EBCA6B);
+  machine->frames = 0;
+  for (uint32_t r = 0; r < e->config.rewards_count; r++)
+    machine->last[r] = chip8_peek(machine->m, e->config.rewards[r]);
+}
+
+static void env_reset_one(void *ctx, uint32_t index) {
+  env_t *e = ctx;
+  machine_reset(e, index);
+  machine_observe(&e->machines[index], e->obs[index]);
+}
+
+static void env_step_one(void *ctx, uint32_t index) {
+  env_t *e = ctx;
+  const env_config_t *c = &e->config;
+  machine_t *machine = &e->machines[index];
+
+  chip8_set_keys(machine->m, e->actions[index]);
+  bool done = false;
+  for (uint32_t f = 0; f < c->frames_per_step && !done; f++)
+    done = chip8_run_frame(machine->m) == -1;
+  machine->frames += c->frames_per_step;
+  done |= c->max_frames != 0 && machine->frames >= c->max_frames;
+
+  int32_t reward = 0;
+  for (uint32_t r = 0; r < c->rewards_count; r++) {
+    uint8_t now = chip8_peek(machine->m, c->rewards[r]);
+    reward += now - machine->last[r];
+    machine->last[r] = now;
+  }
+  e->rewards[index] = reward;
+  e->dones[index] = done;
+
+  if (done)
+    machine_reset(e, index);
+  machine_observe(machine, e->obs[index]);
+}
+
+env_t *env_create(uint32_t count, const env_config_t *c) {
+  EXPECT(c->rewards_count <= ENV_MAX_REWARDS, ({ return nullptr; }));
+  env_t *e = calloc(1, sizeof(*e) + count * sizeof(*e->machines));
+  if (e == nullptr)
+    return nullptr;
+  e->config = *c;
+  e->config.start = c->start ? c->start : CHIP8_PROGRAM_START;
+  e->config.frames_per_step = c->frames_per_step ? c->frames_per_step : 1;
+
+  e->start = chip8_create(c->ips);
+  e->pool = pool_create(c->threads);
+  if (e->start == nullptr || e->pool == nullptr ||
+      chip8_load(e->start, c->rom, c->rom_size, e->config.start) == -1)
+    goto err;
+  for (uint32_t f = 0; f < c->warmup_frames; f++) {
+    if (chip8_run_frame(e->start) == -1)
+      break;
+  }
+
+  for (; e->count < count; e->count++) {
+    e->machines[e->count].m = chip8_create(c->ips);
+    if (e->machines[e->count].m == nullptr)
+      goto err;
+    machine_reset(e, e->count);
+  }
+  return e;
+err:
+  LOG_ERROR("Failed to create %u machines", count);
+  env_destroy(e);
+  return nullptr;
+}
+
+void env_destroy(env_t *e) {
+  if (e == nullptr)
+    return;
+  for (uint32_t i = 0; i < e->count; i++)
+    chip8_destroy(e->machines[i].m);
+  chip8_destroy(e->start);
+  pool_destroy(e->pool);
+  free(e);
+}
+
+void env_reset(env_t *e, env_observation_t *obs) {
+  e->obs = obs;
+  pool_run(e->pool, e->count, env_reset_one, e);
+}
+
+void env_step(env_t *e, const uint16_t *actions, env_observation_t *obs,
+              int32_t *rewards, bool *dones) {
+  e->actions = actions;
+  e->obs = obs;
+  e->rewards = rewards;
+  e->dones = dones;
+  pool_run(e->pool, e->count, env_step_one, e);
+}
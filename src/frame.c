@@ -0,0 +1,123 @@
+#include "frame.h"
+#include "instructions.h"
+#include "log.h"
+#include "state.h"
+#include <string.h>
+
+// everything an instruction without effects can read or change. memory and
+// screen are covered by STATE.effects, keys do not change within a frame
+typedef struct {
+  typeof(STATE.registers) registers;
+  typeof(STATE.timers) timers;
+  uint8_t nest;
+  uint8_t key_wait;
+} snapshot_t;
+
+typedef struct {
+  bool valid;
+  pc_t pc;          // target of the backward jump which closed the loop
+  uint32_t effects; // STATE.effects at that time
+  uint32_t left;    // instructions left in the frame at that time
+  snapshot_t snapshot;
+} loop_t;
+
+static void snapshot_take(snapshot_t *s) {
+  memset(s, 0, sizeof(*s)); // padding takes part in memcmp
+  s->registers = STATE.registers;
+  s->timers = STATE.timers;
+  s->nest = STATE.nest;
+  s->key_wait = STATE.key_wait;
+}
+
+// called when control went backwards. returns how many instructions one
+// iteration of a loop takes, if its last iteration changed nothing. nothing
+// changed means every following iteration is the same up until the end of
+// the frame
+static uint32_t idle_detect(loop_t *loop, uint32_t left) {
+  snapshot_t now;
+  snapshot_take(&now);
+
+  if (loop->valid && loop->pc.v == STATE.registers.PC.v &&
+      loop->effects == STATE.effects &&
+      memcmp(&loop->snapshot, &now, sizeof(now)) == 0) {
+    loop->valid = false;
+    return loop->left - left;
+  }
+
+  *loop = (loop_t){true, STATE.registers.PC, STATE.effects, left, now};
+  return 0;
+}
+
+// at most `left` instructions, returns how many ran
+static inline uint32_t instruction_run(uint32_t left) {
+  instruction_t *i = state_memory_pointer(STATE.registers.PC);
+  LOG_INFO("instruction value: %#x", BSWAP16(*i));
+  uint32_t ran = 1;
+  if (STATE.cache != nullptr)
+    ran = execute_cached(left);
+  else
+    EXPECT(execute(BSWAP16(*i)) != -1,
+           LOG_ERROR("Invalid instruction %u", *i));
+  LOG_STATE();
+  return ran;
+}
+
+int frame_step(uint32_t n) {
+  while (n != 0) {
+    if (STATE.registers.PC.v >= AVALIABLE_MEMORY_END)
+      return -1;
+    uint32_t ran = instruction_run(n);
+    if (ran == 0)
+      return 1;
+    STATE.retired += ran;
+    n -= ran;
+  }
+  return 0;
+}
+
+int frame_run(void) {
+  // a frame a trap stopped is finished first
+  uint32_t left = STATE.frame_left;
+  if (left == 0) {
+    uint32_t ips = STATE.ips ? STATE.ips : IPS_UNLIMITED;
+    left = (ips + STATE.cycles_rest) / FRAMES_PER_SECOND;
+    STATE.cycles_rest = (ips + STATE.cycles_rest) % FRAMES_PER_SECOND;
+  }
+  STATE.frame_left = 0;
+
+  uint32_t budget = left;
+  loop_t loop = {};
+  while (left != 0) {
+    if (STATE.registers.PC.v >= AVALIABLE_MEMORY_END) {
+      STATE.retired += budget - left;
+      return -1;
+    }
+
+    pc_t pc = STATE.registers.PC;
+    uint32_t ran = instruction_run(left);
+    left -= ran;
+
+    if (STATE.registers.PC.v > pc.v)
+      continue;
+    // trap leaves PC where it was, so forward code never gets here
+    if (ran == 0) {
+      STATE.retired += budget - left;
+      STATE.frame_left = left;
+      return 1;
+    }
+
+    uint32_t period = idle_detect(&loop, left);
+    if (period != 0) {
+      LOG_INFO("idle loop at %#x, period %u, skipping %u instructions",
+               STATE.registers.PC.v, period, left - left % period);
+      left %= period;
+    }
+  }
+  STATE.retired += budget;
+
+  if (STATE.timers.delay)
+    STATE.timers.delay--;
+  if (STATE.timers.sound)
+    STATE.timers.sound--;
+  return 0;
+}
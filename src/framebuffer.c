@@ -0,0 +1,53 @@
+#include "framebuffer.h"
+#include "log.h"
+#include <string.h>
+
+extern inline const framebuffer_row_t *framebuffer_pointer(void);
+
+static inline void framebuffer_dirty(void) {
+  STATE.dirty |= 1 << offsetof(typeof(*STATE.mmap), display_refresh) /
+                          STATE_PAGE_SIZE;
+}
+
+void framebuffer_clear(void) {
+  memset(STATE.mmap->display_refresh, 0, sizeof(STATE.mmap->display_refresh));
+  framebuffer_dirty();
+  STATE.redraw = true;
+}
+
+bool framebuffer_draw(uint32_t y, uint32_t x, sprite_t s) {
+  EXPECT(s.size > 0, ({
+           LOG_ERROR("sprite size is out of range (0; 15]. sprite size: %u, "
+                     "sprite data: %p",
+                     s.size, s.data);
+           return false;
+         }));
+
+  x %= WIDTH;
+  y %= HEIGHT;
+
+  framebuffer_row_t *fb = (framebuffer_row_t *)STATE.mmap->display_refresh;
+  uint32_t column = x / UINT8_WIDTH;
+  uint32_t shift = x % UINT8_WIDTH;
+  uint8_t overlap = 0;
+
+  LOG_INFO("drawing sprite from %p of size %u at x(%u), y(%u)", s.data, s.size,
+           x, y);
+  for (uint32_t byte = 0; byte < s.size && y + byte < HEIGHT; byte++) {
+    uint8_t *row = fb[y + byte];
+    // sprite byte spans at most two framebuffer bytes, second one is clipped
+    // at the right edge
+    uint8_t left = s.data[byte] >> shift;
+    overlap |= row[column] & left;
+    row[column] ^= left;
+    if (shift != 0 && column + 1 < FRAMEBUFFER_PITCH) {
+      uint8_t right = s.data[byte] << (UINT8_WIDTH - shift);
+      overlap |= row[column + 1] & right;
+      row[column + 1] ^= right;
+    }
+  }
+
+  framebuffer_dirty();
+  STATE.redraw = true;
+  return overlap != 0;
+}
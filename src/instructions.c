@@ -1,19 +1,18 @@
 #include "instructions.h"
+#include "decode.h"
+#include "framebuffer.h"
+#include "log.h"
 #include "periph.h"
 #include "state.h"
-#include <limits.h>
-#include <stdlib.h>
-
-#define REGISTER_FROM(value, nibble)                                           \
-  (enum gp_registers_t)(((value) & (0xF << ((nibble) * (CHAR_BIT / 2)))) >>    \
-                        ((nibble) * (CHAR_BIT / 2)))
-#define VALUE_FROM(value) ((value) & 0xFF)
-#define ADDRESS_FROM(value) ((address_t){(value) & 0xFFF})
+#include "trap.h"
 
 #define INSTRUCTION static void
 
 /* 0x00E0 */
-INSTRUCTION clear(void) { display_clear(); }
+INSTRUCTION clear(void) {
+  framebuffer_clear();
+  STATE.effects++;
+}
 
 /* 0x00EE */
 INSTRUCTION ret(void) {
@@ -33,6 +32,7 @@ INSTRUCTION call(address_t a) {
     return;
 
   STATE.nest++;
+  STATE.effects++;
   state_sp_str(STATE.registers.PC); // store
   STATE.registers.PC = a;           // load address
 }
@@ -162,10 +162,21 @@ INSTRUCTION jump_v0(address_t a) {
   STATE.registers.PC.v = a.v + STATE.registers.V0;
 }
 
+// per machine, so machines on different threads stay reproducible
+static inline uint8_t rng_next(void) {
+  uint32_t x = STATE.rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  STATE.rng = x;
+  return x;
+}
+
 /* 0xCXNN */
 INSTRUCTION get_rand(enum gp_registers_t v, uint8_t value) {
   gp_register_value_t *_v = state_register_value(v);
-  *_v = rand() & value;
+  *_v = rng_next() & value;
+  STATE.effects++;
 }
 
 /* 0xDXYN */
@@ -177,21 +188,25 @@ INSTRUCTION draw(enum gp_registers_t vx, enum gp_registers_t vy,
   sprite_t s;
   s.data = state_memory_pointer(STATE.registers.I);
   s.size = value.v;
-  STATE.registers.VF = display_draw(_vy, _vx, s);
+  STATE.registers.VF = framebuffer_draw(_vy, _vx, s);
+  STATE.effects++;
+  STATE.draws++;
+}
+
+static inline bool key_held(gp_register_value_t key) {
+  return key <= CHIP_KEY_F && (STATE.keys & (1 << key)) != 0;
 }
 
 /* 0xEX9E */
 INSTRUCTION rk_eq_si(enum gp_registers_t v) {
   gp_register_value_t _v = *state_register_value(v);
-  STATE.registers.PC.v +=
-      _v == keyboard_get_key_nonblocking() ? INSTRUCTION_SIZE : 0;
+  STATE.registers.PC.v += key_held(_v) ? INSTRUCTION_SIZE : 0;
 }
 
 /* 0xEXA1 */
 INSTRUCTION rk_neq_si(enum gp_registers_t v) {
   gp_register_value_t _v = *state_register_value(v);
-  STATE.registers.PC.v +=
-      _v != keyboard_get_key_nonblocking() ? INSTRUCTION_SIZE : 0;
+  STATE.registers.PC.v += !key_held(_v) ? INSTRUCTION_SIZE : 0;
 }
 
 /* 0xFX07 */
@@ -200,10 +215,21 @@ INSTRUCTION get_delay_timer(enum gp_registers_t v) {
   *_v = STATE.timers.delay;
 }
 
+/* Waits for a key to be pressed and released, like the original. */
+/* Waiting is done by executing the instruction again. */
 /* 0xFX0A */
 INSTRUCTION get_key(enum gp_registers_t v) {
+  if (STATE.key_wait == 0 && STATE.keys != 0)
+    STATE.key_wait = __builtin_ctz(STATE.keys) + 1;
+
+  if (STATE.key_wait == 0 || key_held(STATE.key_wait - 1)) {
+    STATE.registers.PC.v -= INSTRUCTION_SIZE;
+    return;
+  }
+
   gp_register_value_t *_v = state_register_value(v);
-  *_v = keyboard_get_key_blocking();
+  *_v = STATE.key_wait - 1;
+  STATE.key_wait = 0;
 }
 
 /* 0xFX15 */
@@ -245,6 +271,9 @@ INSTRUCTION bcd_str(enum gp_registers_t v) {
   p[0] = hundreds;
   p[1] = tens;
   p[2] = ones;
+  decode_invalidate(STATE.registers.I, 3);
+  state_memory_dirty(STATE.registers.I, 3);
+  STATE.effects++;
 }
 
 /* inclusive. */
@@ -253,10 +282,13 @@ INSTRUCTION register_dump(enum gp_registers_t v_end) {
   gp_register_value_t *reg = &STATE.registers.V0;
   gp_register_value_t *dest = state_memory_pointer(STATE.registers.I);
   gp_register_value_t cur = REG_V0;
+  decode_invalidate(STATE.registers.I, v_end + 1);
+  state_memory_dirty(STATE.registers.I, v_end + 1);
   STATE.registers.I.v += v_end + 1;
   do
     *dest++ = *reg++;
   while (cur++ != v_end);
+  STATE.effects++;
 }
 
 /* inclusive. */
@@ -271,136 +303,171 @@ INSTRUCTION register_load(enum gp_registers_t v_end) {
   while (cur++ != v_end);
 }
 
-int execute(instruction_t i) {
-  STATE.registers.PC.v += INSTRUCTION_SIZE;
-  uint16_t top_nibble = i & 0xF000;
-  switch (top_nibble >> 12) {
-  case 0x0:
-    if ((i & 0x00E0) == i) {
-      clear();
-      break;
-    } else if ((i & 0x00EE) == i) {
-      ret();
-      break;
-    }
-    return -1;
-  case 0x1:
+static inline int execute_op(opcode_t op, instruction_t i) {
+  enum gp_registers_t x = REGISTER_FROM(i, 2);
+  enum gp_registers_t y = REGISTER_FROM(i, 1);
+  switch (op) {
+  case OP_CLS:
+    clear();
+    break;
+  case OP_RET:
+    ret();
+    break;
+  case OP_JP:
     jump(ADDRESS_FROM(i));
     break;
-  case 0x2:
+  case OP_CALL:
     call(ADDRESS_FROM(i));
     break;
-  case 0x3:
-    rl_eq_si(REGISTER_FROM(i, 2), VALUE_FROM(i));
-    break;
-  case 0x4:
-    rl_neq_si(REGISTER_FROM(i, 2), VALUE_FROM(i));
-    break;
-  case 0x5:
-    if ((i & 0xF) != 0)
-      return -1;
-    rr_eq_si(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-    break;
-  case 0x6:
-    rl_ld(REGISTER_FROM(i, 2), VALUE_FROM(i));
-    break;
-  case 0x7:
-    rl_add(REGISTER_FROM(i, 2), VALUE_FROM(i));
-    break;
-  case 0x8:
-    switch (i & 0xF) {
-    case 0x0:
-      rr_ld(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x1:
-      rr_orr(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x2:
-      rr_and(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x3:
-      rr_xor(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x4:
-      rr_add(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x5:
-      rr_sub(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x6:
-      rr_ld_shr(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0x7:
-      rr_sub_reversed(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    case 0xE:
-      rr_ld_shl(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
-      break;
-    default:
-      return -1;
-    }
+  case OP_SE_NN:
+    rl_eq_si(x, VALUE_FROM(i));
+    break;
+  case OP_SNE_NN:
+    rl_neq_si(x, VALUE_FROM(i));
+    break;
+  case OP_SE_VY:
+    rr_eq_si(x, y);
+    break;
+  case OP_LD_NN:
+    rl_ld(x, VALUE_FROM(i));
+    break;
+  case OP_ADD_NN:
+    rl_add(x, VALUE_FROM(i));
+    break;
+  case OP_LD_VY:
+    rr_ld(x, y);
+    break;
+  case OP_OR:
+    rr_orr(x, y);
+    break;
+  case OP_AND:
+    rr_and(x, y);
+    break;
+  case OP_XOR:
+    rr_xor(x, y);
+    break;
+  case OP_ADD_VY:
+    rr_add(x, y);
+    break;
+  case OP_SUB:
+    rr_sub(x, y);
+    break;
+  case OP_SHR:
+    rr_ld_shr(x, y);
+    break;
+  case OP_SUBN:
+    rr_sub_reversed(x, y);
     break;
-  case 0x9:
-    if ((i & 0xF) != 0)
-      return -1;
-    rr_neq_si(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1));
+  case OP_SHL:
+    rr_ld_shl(x, y);
     break;
-  case 0xA:
+  case OP_SNE_VY:
+    rr_neq_si(x, y);
+    break;
+  case OP_LD_I:
     I_ld(ADDRESS_FROM(i));
     break;
-  case 0xB:
+  case OP_JP_V0:
     jump_v0(ADDRESS_FROM(i));
     break;
-  case 0xC:
-    get_rand(REGISTER_FROM(i, 2), VALUE_FROM(i));
+  case OP_RND:
+    get_rand(x, VALUE_FROM(i));
     break;
-  case 0xD:
-    draw(REGISTER_FROM(i, 2), REGISTER_FROM(i, 1), (half_byte_t){i & 0xF});
+  case OP_DRW:
+    draw(x, y, (half_byte_t){i & 0xF});
     break;
-  case 0xE:
-    if ((i & 0xFF) == 0x9E) {
-      rk_eq_si(REGISTER_FROM(i, 2));
-      break;
-    } else if ((i & 0xFF) == 0xA1) {
-      rk_neq_si(REGISTER_FROM(i, 2));
-      break;
-    }
-    return -1;
-  case 0xF:
-    switch (i & 0xFF) {
-    case 0x07:
-      get_delay_timer(REGISTER_FROM(i, 2));
-      break;
-    case 0x0A:
-      get_key(REGISTER_FROM(i, 2));
-      break;
-    case 0x15:
-      set_delay_timer(REGISTER_FROM(i, 2));
-      break;
-    case 0x18:
-      set_sound_timer(REGISTER_FROM(i, 2));
-      break;
-    case 0x1E:
-      I_add(REGISTER_FROM(i, 2));
-      break;
-    case 0x29:
-      I_ld_sprite(REGISTER_FROM(i, 2));
-      break;
-    case 0x33:
-      bcd_str(REGISTER_FROM(i, 2));
-      break;
-    case 0x55:
-      register_dump(REGISTER_FROM(i, 2));
-      break;
-    case 0x65:
-      register_load(REGISTER_FROM(i, 2));
-      break;
-    default:
-      return -1;
-    }
+  case OP_SKP:
+    rk_eq_si(x);
+    break;
+  case OP_SKNP:
+    rk_neq_si(x);
+    break;
+  case OP_LD_VX_DT:
+    get_delay_timer(x);
+    break;
+  case OP_LD_K:
+    get_key(x);
+    break;
+  case OP_LD_DT:
+    set_delay_timer(x);
     break;
-  default:
+  case OP_LD_ST:
+    set_sound_timer(x);
+    break;
+  case OP_ADD_I:
+    I_add(x);
+    break;
+  case OP_LD_F:
+    I_ld_sprite(x);
+    break;
+  case OP_LD_B:
+    bcd_str(x);
+    break;
+  case OP_LD_I_VX:
+    register_dump(x);
+    break;
+  case OP_LD_VX_I:
+    register_load(x);
+    break;
+  case OP_INVALID:
+  case OP_COUNT:
     return -1;
   }
   return 0;
 }
+
+int execute(instruction_t i) {
+  STATE.registers.PC.v += INSTRUCTION_SIZE;
+  return execute_op(decode(i), i);
+}
+
+uint32_t execute_cached(uint32_t left) {
+  const decoded_t *d = decode_fetch(STATE.registers.PC);
+  if (d->super == SUPER_NONE || d->count > left) {
+    STATE.registers.PC.v += INSTRUCTION_SIZE;
+    EXPECT(execute_op(d->op, d->words[0]) != -1,
+           LOG_ERROR("Invalid instruction %#x", d->words[0]));
+    return 1;
+  }
+
+  const instruction_t *w = d->words;
+  STATE.registers.PC.v += d->count * INSTRUCTION_SIZE;
+  switch (d->super) {
+  case SUPER_LD_I_DRW:
+    I_ld(ADDRESS_FROM(w[0]));
+    draw(REGISTER_FROM(w[1], 2), REGISTER_FROM(w[1], 1),
+         (half_byte_t){w[1] & 0xF});
+    break;
+  case SUPER_LD_I_LOAD:
+    I_ld(ADDRESS_FROM(w[0]));
+    register_load(REGISTER_FROM(w[1], 2));
+    break;
+  case SUPER_LD_NN_RUN:
+    for (uint32_t k = 0; k < d->count; k++)
+      rl_ld(REGISTER_FROM(w[k], 2), VALUE_FROM(w[k]));
+    break;
+  case SUPER_COUNT_LOOP: {
+    enum gp_registers_t x = REGISTER_FROM(w[0], 2);
+    rl_add(x, VALUE_FROM(w[0]));
+    // PC is past the jump already, which is where the skip goes
+    bool equal = *state_register_value(x) == VALUE_FROM(w[1]);
+    bool skip_if_equal = w[1] >> 12 == 0x3; // 3XNN, or 4XNN
+    if (equal == skip_if_equal)
+      return 2;
+    jump(ADDRESS_FROM(w[2]));
+    break;
+  }
+  case SUPER_TRAP:
+    if (trap_hit(d, STATE.registers.PC.v - INSTRUCTION_SIZE)) {
+      STATE.registers.PC.v -= INSTRUCTION_SIZE;
+      return 0;
+    }
+    // a watched store may overwrite this very entry, d is stale after it
+    EXPECT(execute_op(d->op, w[0]) != -1,
+           LOG_ERROR("Invalid instruction %#x", w[0]));
+    return 1;
+  case SUPER_NONE:
+    break;
+  }
+  return d->count;
+}
@@ -1,24 +1,44 @@
-#include "instructions.h"
+#include "chip8.h"
+#include "debugger.h"
+#include "frame.h"
 #include "log.h"
+#include "metrics.h"
 #include "periph.h"
+#include "render.h"
 #include "state.h"
+#include "stream.h"
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 static_assert(CHAR_BIT == 8);
 
-#ifdef LITTLE_ENDIAN
-#define BSWAP16(x) __builtin_bswap16((x))
-#else
-#define BSWAP16(x) (x)
-#endif
-#define SEED (69) // nice
-
 static int fclose_cleanup(FILE **f) { return fclose(*f); }
-static void exit_cleanup(void) { display_exit(); }
+static void chip8_cleanup(chip8_t **m) { chip8_destroy(*m); }
+static void exit_cleanup(void) {
+  render_stop(); // terminal and stream are back on this thread
+  debugger_exit();
+  stream_exit();
+  display_exit();
+}
+
+#define NSEC_PER_FRAME (1'000'000'000 / FRAMES_PER_SECOND)
+// frames which are already late are not caught up on
+static void deadline_advance(struct timespec *deadline) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  deadline->tv_nsec += NSEC_PER_FRAME;
+  if (deadline->tv_nsec >= 1'000'000'000) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1'000'000'000;
+  }
+  if (deadline->tv_sec < now.tv_sec ||
+      (deadline->tv_sec == now.tv_sec && deadline->tv_nsec < now.tv_nsec))
+    *deadline = now;
+}
 
 long str_parse(const char *str) {
   char *end = nullptr;
@@ -35,14 +55,41 @@ typedef struct {
   char *prog_name;
   address_t start_address;
   instructions_per_second_t ips;
+  renderer_t renderer;
+  char *stream_path;
+  char *stats_path;
+  char *debugger_path;
 } args_t;
 
+static int renderer_parse(const char *str) {
+  static const char *const NAMES[] = {
+      [RENDERER_ASCII] = "ascii",
+      [RENDERER_HALF_BLOCK] = "half",
+      [RENDERER_BRAILLE] = "braille",
+  };
+  for (uint32_t i = 0; i < ARRAY_SIZE(NAMES); i++) {
+    if (strcmp(str, NAMES[i]) == 0)
+      return i;
+  }
+  printf("Cant parse %s as renderer (ascii, half, braille)\n", str);
+  return -1;
+}
+
 args_t get_args(int argc, char *argv[]) {
-  args_t args = {nullptr, {PROGRAM_START}, DEFAULT_IPS};
+  args_t args = {nullptr, {PROGRAM_START}, DEFAULT_IPS, RENDERER_ASCII,
+                 nullptr, nullptr, nullptr};
   char option;
   long res;
-  while ((option = getopt(argc, argv, "s:p:i:")) != -1) {
+  while ((option = getopt(argc, argv, "s:p:i:r:S:m:d:")) != -1) {
     switch (option) {
+    case 'r':
+      res = renderer_parse(optarg);
+      if (res == -1) {
+        printf("Invalid argument %s\n", optarg);
+        goto err;
+      }
+      args.renderer = res;
+      break;
     case 'i':
       res = str_parse(optarg);
       if (res == -1) {
@@ -62,6 +109,15 @@ args_t get_args(int argc, char *argv[]) {
     case 'p':
       args.prog_name = optarg;
       break;
+    case 'S':
+      args.stream_path = optarg;
+      break;
+    case 'm':
+      args.stats_path = optarg;
+      break;
+    case 'd':
+      args.debugger_path = optarg;
+      break;
     default:
       printf("Invalid option %c\n", option);
       goto err;
@@ -80,7 +136,6 @@ err:
 
 int main(int argc, char *argv[]) {
   atexit(&exit_cleanup);
-  srand(SEED);
 
   args_t args = get_args(argc, argv);
   if (args.prog_name == nullptr)
@@ -92,31 +147,47 @@ int main(int argc, char *argv[]) {
            return EXIT_FAILURE;
          }));
 
-  LOG_INFO("seed: %u", SEED);
+  LOG_INFO("seed: %u", RNG_SEED);
   LOG_INFO("program: %s", args.prog_name);
   LOG_INFO("start address: %#x", args.start_address.v);
 
-  EXPECT(state_init(args.ips, args.start_address, prog) != -1, ({
+  uint8_t rom[MEMORY_SIZE];
+  size_t size = fread(rom, sizeof(*rom), sizeof(rom), prog);
+  [[gnu::cleanup(chip8_cleanup)]] chip8_t *m = chip8_create(args.ips);
+  EXPECT(m != nullptr && chip8_load(m, rom, size, args.start_address.v) != -1,
+         ({
            printf("Failed to init state");
            return EXIT_FAILURE;
          }));
 
-  EXPECT(display_init() != -1, ({ return EXIT_FAILURE; }));
-
-  uint64_t useconds = 1'000'000 / (STATE.ips ? STATE.ips : 1'000'000);
-  LOG_INFO("sleep: %lu", useconds);
-  while (STATE.registers.PC.v < AVALIABLE_MEMORY_END) {
-    instruction_t *i = state_memory_pointer(STATE.registers.PC);
-    LOG_INFO("instruction value: %#x", BSWAP16(*i));
-    EXPECT(execute(BSWAP16(*i)) != -1, LOG_ERROR("Invalid instruction %u", *i));
-    if (STATE.timers.delay)
-      STATE.timers.delay--;
-    if (STATE.timers.sound) {
-      sound_beep();
-      STATE.timers.sound--;
-    }
-    LOG_STATE();
-    usleep(useconds);
-  }
+  EXPECT(display_init(args.renderer) != -1, ({ return EXIT_FAILURE; }));
+  if (args.stream_path != nullptr)
+    EXPECT(stream_init(args.stream_path) != -1, ({ return EXIT_FAILURE; }));
+  if (args.debugger_path != nullptr)
+    EXPECT(debugger_init(args.debugger_path) != -1,
+           ({ return EXIT_FAILURE; }));
+  EXPECT(render_start() != -1, ({ return EXIT_FAILURE; }));
+
+  uint32_t ips_target = args.ips ? args.ips : IPS_UNLIMITED;
+  EXPECT(metrics_init(ips_target, args.stats_path) != -1,
+         ({ return EXIT_FAILURE; }));
+  char status[METRICS_STATUS_SIZE];
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  do {
+    metrics_frame_done();
+    bool fresh = metrics_publish(chip8_retired(m), chip8_draws(m), status,
+                                 sizeof(status));
+    // the render thread picks the newest frame up at its own pace
+    render_publish(chip8_framebuffer(m), chip8_sound(m),
+                   fresh ? status : nullptr);
+
+    deadline_advance(&deadline);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr);
+    metrics_wake(&deadline);
+    uint16_t keys = render_keys();
+    metrics_keys(keys);
+    chip8_set_keys(m, keys);
+  } while (debugger_frame(m) != -1);
   return EXIT_SUCCESS;
 }
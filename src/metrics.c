@@ -0,0 +1,147 @@
+#include "metrics.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NSEC_PER_SEC (1'000'000'000)
+#define NSEC_PER_USEC (1'000)
+#define MAX_PATH (512)
+
+static metrics_t METRICS = {};
+static const char *PATH = nullptr;
+static struct timespec WINDOW_START, LAST_WAKE, KEY_SEEN;
+static bool KEY_PENDING = false;
+static uint16_t LAST_KEYS = 0;
+static uint64_t LAST_RETIRED = 0;
+static uint32_t LAST_DRAWS = 0;
+
+static int64_t ns_between(const struct timespec *a, const struct timespec *b) {
+  return (int64_t)(b->tv_sec - a->tv_sec) * NSEC_PER_SEC +
+         (b->tv_nsec - a->tv_nsec);
+}
+
+static void histogram_add(histogram_t *h, int64_t ns) {
+  uint64_t us = ns > 0 ? ns / NSEC_PER_USEC : 0;
+  uint32_t bucket = us > 1 ? 63 - __builtin_clzll(us) : 0;
+  h->counts[bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1]++;
+  h->total++;
+  h->sum_us += us;
+}
+
+// upper bound of the bucket holding the `p` percent sample, in microseconds
+static uint64_t histogram_percentile(const histogram_t *h, uint32_t p) {
+  uint64_t want = ((uint64_t)h->total * p + 99) / 100, seen = 0;
+  for (uint32_t b = 0; b < METRICS_BUCKETS; b++) {
+    seen += h->counts[b];
+    if (seen >= want && seen != 0)
+      return 2ull << b;
+  }
+  return 0;
+}
+
+static void histogram_print(FILE *f, const char *name, const histogram_t *h) {
+  fprintf(f, "%s", name);
+  for (uint32_t b = 0; b < METRICS_BUCKETS; b++)
+    fprintf(f, " %u", h->counts[b]);
+  fprintf(f, "\n");
+}
+
+// written next to the old one and renamed over it, readers never see half
+static void stats_write(void) {
+  char tmp[MAX_PATH];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", PATH);
+  FILE *f = fopen(tmp, "w");
+  EXPECT(f != nullptr, ({
+           LOG_ERROR("Failed to write stats to %s", tmp);
+           return;
+         }));
+  fprintf(f, "ips_target %u\nips %u\nframes %u\ndraws_per_frame %.2f\n",
+          METRICS.ips_target, METRICS.ips, METRICS.frames,
+          METRICS.draws_per_frame);
+  // bucket n is [2^n, 2^(n+1)) microseconds
+  histogram_print(f, "frame_time_us", &METRICS.frame_time);
+  histogram_print(f, "oversleep_us", &METRICS.oversleep);
+  histogram_print(f, "key_latency_us", &METRICS.key_latency);
+  if (fclose(f) != 0 || rename(tmp, PATH) != 0)
+    LOG_ERROR("Failed to replace stats at %s", PATH);
+}
+
+int metrics_init(uint32_t ips_target, const char *path) {
+  // temporary file name must fit too, or it would be renamed over another
+  EXPECT(path == nullptr || strlen(path) + sizeof(".tmp") <= MAX_PATH, ({
+           LOG_ERROR("stats path is too long: %s", path);
+           return -1;
+         }));
+  METRICS = (metrics_t){.ips_target = ips_target};
+  PATH = path;
+  clock_gettime(CLOCK_MONOTONIC, &WINDOW_START);
+  LAST_WAKE = WINDOW_START;
+  return 0;
+}
+
+void metrics_wake(const struct timespec *deadline) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  histogram_add(&METRICS.frame_time, ns_between(&LAST_WAKE, &now));
+  histogram_add(&METRICS.oversleep, ns_between(deadline, &now));
+  LAST_WAKE = now;
+  METRICS.frames++;
+}
+
+void metrics_keys(uint16_t keys) {
+  if ((keys & ~LAST_KEYS) != 0 && !KEY_PENDING) {
+    KEY_SEEN = LAST_WAKE;
+    KEY_PENDING = true;
+  }
+  LAST_KEYS = keys;
+}
+
+void metrics_frame_done(void) {
+  if (!KEY_PENDING)
+    return;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  histogram_add(&METRICS.key_latency, ns_between(&KEY_SEEN, &now));
+  KEY_PENDING = false;
+}
+
+// mean and 99th percentile
+static void histogram_format(char *buf, size_t size, const histogram_t *h) {
+  if (h->total == 0) {
+    snprintf(buf, size, "-");
+    return;
+  }
+  snprintf(buf, size, "%.1fms p99<%.1fms", h->sum_us / 1e3 / h->total,
+           histogram_percentile(h, 99) / 1e3);
+}
+
+bool metrics_publish(uint64_t retired, uint32_t draws, char *status,
+                     size_t size) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t ns = ns_between(&WINDOW_START, &now);
+  if (ns < NSEC_PER_SEC)
+    return false;
+
+  METRICS.ips = (retired - LAST_RETIRED) * NSEC_PER_SEC / ns;
+  METRICS.draws_per_frame =
+      METRICS.frames ? (double)(draws - LAST_DRAWS) / METRICS.frames : 0;
+  if (PATH != nullptr)
+    stats_write();
+
+  char frame[32], oversleep[32], key[32];
+  histogram_format(frame, sizeof(frame), &METRICS.frame_time);
+  histogram_format(oversleep, sizeof(oversleep), &METRICS.oversleep);
+  histogram_format(key, sizeof(key), &METRICS.key_latency);
+  snprintf(status, size,
+           "ips %u/%u fps %u | frame %s | oversleep %s | key %s | "
+           "draws %.1f/frame",
+           METRICS.ips, METRICS.ips_target, METRICS.frames, frame, oversleep,
+           key, METRICS.draws_per_frame);
+
+  METRICS = (metrics_t){.ips_target = METRICS.ips_target};
+  WINDOW_START = now;
+  LAST_RETIRED = retired;
+  LAST_DRAWS = draws;
+  return true;
+}
@@ -0,0 +1,84 @@
+#include "page.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the reference it holds on itself keeps it from being freed or written
+static page_t ZERO = {.refs = 1, .id = PAGE_ZERO_ID};
+static atomic_uint_fast64_t IDS = PAGE_ZERO_ID + 1;
+// pages of fresh programs by contents, each holding a reference, so loading
+// the same ROM into another machine shares it. other bytes hashing to a slot
+// take it over
+static page_t *INTERNED[PAGE_INTERNED];
+static pthread_mutex_t INTERNED_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t page_id(void) {
+  return atomic_fetch_add_explicit(&IDS, 1, memory_order_relaxed);
+}
+
+page_t *page_new(const uint8_t *bytes) {
+  page_t *p = malloc(sizeof(*p));
+  if (p == nullptr)
+    return nullptr;
+  atomic_init(&p->refs, 1);
+  p->id = page_id();
+  memcpy(p->bytes, bytes, sizeof(p->bytes));
+  return p;
+}
+
+page_t *page_zero(void) { return page_share(&ZERO); }
+
+page_t *page_intern(const uint8_t *bytes) {
+  static const uint8_t ZEROS[STATE_PAGE_SIZE] = {};
+  if (memcmp(bytes, ZEROS, sizeof(ZEROS)) == 0)
+    return page_zero();
+  uint64_t h = 0xcbf29ce484222325;
+  for (uint32_t b = 0; b < STATE_PAGE_SIZE; b += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + b, sizeof(word));
+    h = (h ^ word) * 0x9E3779B97F4A7C15;
+    h ^= h >> 29;
+  }
+
+  page_t **slot = &INTERNED[h % PAGE_INTERNED];
+  pthread_mutex_lock(&INTERNED_LOCK);
+  page_t *p = *slot;
+  if (p != nullptr && memcmp(p->bytes, bytes, sizeof(p->bytes)) == 0) {
+    page_share(p);
+  } else if ((p = page_new(bytes)) != nullptr) {
+    if (*slot != nullptr)
+      page_release(*slot);
+    *slot = page_share(p);
+  }
+  pthread_mutex_unlock(&INTERNED_LOCK);
+  return p;
+}
+
+page_t *page_share(page_t *p) {
+  atomic_fetch_add_explicit(&p->refs, 1, memory_order_relaxed);
+  return p;
+}
+
+void page_release(page_t *p) {
+  if (atomic_fetch_sub_explicit(&p->refs, 1, memory_order_release) != 1)
+    return;
+  atomic_thread_fence(memory_order_acquire);
+  free(p);
+}
+
+page_t *page_write(page_t *p, const uint8_t *bytes) {
+  // stores of what was there keep the page shared and its id, so machines
+  // which only wrote the same bytes need no copy when switched between
+  if (memcmp(p->bytes, bytes, sizeof(p->bytes)) == 0)
+    return p;
+  // a single reference is the caller's, nobody can take another meanwhile
+  if (atomic_load_explicit(&p->refs, memory_order_acquire) == 1) {
+    memcpy(p->bytes, bytes, sizeof(p->bytes));
+    p->id = page_id();
+    return p;
+  }
+  page_t *copy = page_new(bytes);
+  if (copy != nullptr)
+    page_release(p);
+  return copy;
+}
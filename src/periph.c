@@ -2,10 +2,28 @@
 #include "log.h"
 #include <locale.h>
 #include <ncurses.h>
+#include <string.h>
+#include <wchar.h>
 
 WINDOW *WIN = nullptr;
+static WINDOW *STATUS = nullptr; // bottom line, if the screen has room for it
 
-int display_init(void) {
+typedef struct {
+  uint32_t cell_w; // pixels per cell
+  uint32_t cell_h;
+} renderer_info_t;
+
+static constexpr renderer_info_t RENDERERS[] = {
+    [RENDERER_ASCII] = {1, 1},
+    [RENDERER_HALF_BLOCK] = {1, 2},
+    [RENDERER_BRAILLE] = {2, 4},
+};
+
+static renderer_t RENDERER = RENDERER_ASCII;
+// what is currently on the terminal
+static uint8_t SHOWN[HEIGHT][WIDTH / UINT8_WIDTH];
+
+int display_init(renderer_t r) {
   setlocale(LC_ALL, "");
   EXPECT(initscr(), ({
            LOG_ERROR("failed to init curses");
@@ -17,9 +35,10 @@ int display_init(void) {
   curs_set(0);
   LOG_INFO("curses were intialized");
 
+  RENDERER = r;
   // + 2 for borders
-  uint32_t h = HEIGHT + 2;
-  uint32_t w = WIDTH + 2;
+  uint32_t h = HEIGHT / RENDERERS[r].cell_h + 2;
+  uint32_t w = WIDTH / RENDERERS[r].cell_w + 2;
 
   uint32_t rows, cols;
   getmaxyx(stdscr, rows, cols);
@@ -40,7 +59,16 @@ int display_init(void) {
            goto err;
          }));
 
-  display_clear();
+  if (rows > start_y + h) {
+    STATUS = newwin(1, cols, rows - 1, 0);
+    EXPECT(STATUS, LOG_ERROR("failed to create status line"));
+  }
+
+  // blank window matches blank framebuffer
+  memset(SHOWN, 0, sizeof(SHOWN));
+  werase(WIN);
+  box(WIN, '|', '-');
+  wrefresh(WIN);
   return 0;
 
 err:
@@ -50,69 +78,74 @@ err:
 
 void display_exit(void) {
   LOG_INFO("exiting display");
+  if (STATUS != nullptr)
+    EXPECT(delwin(STATUS) == OK, LOG_ERROR("failed to delete status line"));
   if (WIN != nullptr)
     EXPECT(delwin(WIN) == OK, LOG_ERROR("failed to delete CHIP-window"));
   EXPECT(endwin() == OK, LOG_ERROR("endwin failed"));
 }
 
-void display_clear(void) {
-  werase(WIN);
-  box(WIN, '|', '-');
-  wrefresh(WIN);
+static inline uint32_t pixel(const uint8_t (*fb)[WIDTH / UINT8_WIDTH],
+                             uint32_t y, uint32_t x) {
+  return (fb[y][x / UINT8_WIDTH] >> (UINT8_WIDTH - 1 - x % UINT8_WIDTH)) & 1;
 }
 
-#define PIXEL '#'
-#define BLANK ' '
-bool display_draw(uint32_t y, uint32_t x, sprite_t s) {
-  EXPECT(s.size > 0, ({
-           LOG_ERROR("sprite size is out of range (0; 15]. sprite size: %u, "
-                     "sprite data: %p",
-                     s.size, s.data);
-           return false;
-         }));
-
-  // 0,0 is the border of a screen. offset by one
-  x = (x % WIDTH) + 1;
-  y = (y % HEIGHT) + 1;
-
-  bool overlap = false;
-  uint32_t _x = x;
-  uint32_t _y = y;
-  uint8_t sprite_data[MAX_SPRITE_SIZE];
-
-  for (uint32_t byte = 0; byte < s.size; byte++, _y += 1) {
-    sprite_data[byte] = s.data[byte]; // copy byte
-    uint8_t drawn = 0;
-    // get already drawn byte
-    for (int32_t bit = UINT8_WIDTH - 1; bit >= 0; bit--) {
-      _x = x + (UINT8_WIDTH - bit - 1);
-      drawn |= (mvwinch(WIN, _y, _x) == BLANK ? 0 : 1) << bit;
-    }
-    // check overlaps
-    if ((drawn & sprite_data[byte]) != 0) {
-      LOG_INFO("sprites overlap at byte %u. drawn sprite: %b, sprite_to_draw: "
-               "%b. performing XOR",
-               byte, drawn, sprite_data[byte]);
-      overlap = true;
-    }
-    sprite_data[byte] ^= drawn; // xor in
+#define PIXEL L'#'
+#define BLANK L' '
+static wchar_t cell_glyph(const uint8_t (*fb)[WIDTH / UINT8_WIDTH], uint32_t y,
+                          uint32_t x) {
+  switch (RENDERER) {
+  case RENDERER_ASCII:
+    return pixel(fb, y, x) ? PIXEL : BLANK;
+  case RENDERER_HALF_BLOCK: {
+    static constexpr wchar_t HALVES[] = {BLANK, L'\u2584', L'\u2580',
+                                         L'\u2588'}; // ' ', lower, upper, full
+    return HALVES[pixel(fb, y, x) << 1 | pixel(fb, y + 1, x)];
+  }
+  case RENDERER_BRAILLE: {
+    // braille dot numbering, column major with the bottom row added last
+    static constexpr uint8_t DOTS[4][2] = {
+        {0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+    wchar_t dots = 0;
+    for (uint32_t dy = 0; dy < 4; dy++)
+      for (uint32_t dx = 0; dx < 2; dx++)
+        dots |= pixel(fb, y + dy, x + dx) ? DOTS[dy][dx] : 0;
+    return L'\u2800' + dots;
   }
+  }
+  return BLANK;
+}
 
-  // draw
-  _x = x;
-  _y = y;
-  LOG_INFO("drawing sprite from %p of size %u at x(%u), y(%u)", s.data, s.size,
-           _x, _y);
-  for (uint32_t byte = 0; byte < s.size && _y <= HEIGHT; byte++, _y += 1) {
-    for (int32_t bit = UINT8_WIDTH; bit >= 1 && x + UINT8_WIDTH - bit <= WIDTH;
-         bit--) {
-      _x = x + UINT8_WIDTH - bit;
-      uint8_t pixel = sprite_data[byte] & BITu8(bit - 1) ? PIXEL : BLANK;
-      mvwprintw(WIN, _y, _x, "%c", pixel);
+void display_present(const uint8_t (*fb)[WIDTH / UINT8_WIDTH]) {
+  uint32_t cell_w = RENDERERS[RENDERER].cell_w;
+  uint32_t cell_h = RENDERERS[RENDERER].cell_h;
+  if (memcmp(SHOWN, fb, sizeof(SHOWN)) == 0)
+    return; // nothing to refresh either
+
+  for (uint32_t y = 0; y < HEIGHT; y += cell_h) {
+    // skip whole cell rows which did not change
+    if (memcmp(&SHOWN[y], &fb[y], cell_h * sizeof(*SHOWN)) == 0)
+      continue;
+
+    for (uint32_t x = 0; x < WIDTH; x += cell_w) {
+      wchar_t glyph = cell_glyph(fb, y, x);
+      if (glyph == cell_glyph((const uint8_t (*)[WIDTH / UINT8_WIDTH])SHOWN,
+                              y, x))
+        continue;
+      // 0,0 is the border of a screen. offset by one
+      mvwaddnwstr(WIN, y / cell_h + 1, x / cell_w + 1, &glyph, 1);
     }
   }
+  memcpy(SHOWN, fb, sizeof(SHOWN));
   wrefresh(WIN);
-  return overlap;
+}
+
+void display_status(const char *text) {
+  if (STATUS == nullptr)
+    return;
+  werase(STATUS);
+  waddnstr(STATUS, text, getmaxx(STATUS) - 1);
+  wrefresh(STATUS);
 }
 
 static constexpr int32_t KEY_LIST[] = {
@@ -124,39 +157,29 @@ static constexpr int32_t KEY_LIST[] = {
     [CHIP_KEY_F] = 'v',
 };
 
-static void drop_input(void) {
-  nodelay(WIN, true);
-  while (wgetch(WIN) != ERR); // discard held key
-  nodelay(WIN, false);
-}
-
-keys_t keyboard_get_key_nonblocking(void) {
-  wtimeout(WIN, 250);
-  int32_t ch = wgetch(WIN);
-  wtimeout(WIN, -1);
-  drop_input();
+// terminals only report presses, key is considered held for this long after
+// its last press or autorepeat
+#define KEY_HOLD_FRAMES (15)
 
-  if (ch == ERR)
-    return CHIP_KEY_NONE;
+uint16_t keyboard_poll(void) {
+  static uint8_t held[ARRAY_SIZE(KEY_LIST)] = {};
 
-  for (uint32_t i = 0; i < ARRAY_SIZE(KEY_LIST); i++) {
-    if (ch == KEY_LIST[i])
-      return (keys_t)i;
-  }
+  for (uint32_t i = 0; i < ARRAY_SIZE(held); i++)
+    held[i] -= held[i] != 0;
 
-  return CHIP_KEY_NONE;
-}
-
-keys_t keyboard_get_key_blocking(void) {
-  while (true) {
-    int32_t ch = wgetch(WIN);
-    drop_input();
-    while (wgetch(WIN) != ERR); // discard held key
+  nodelay(WIN, true);
+  int32_t ch;
+  while ((ch = wgetch(WIN)) != ERR) {
     for (uint32_t i = 0; i < ARRAY_SIZE(KEY_LIST); i++) {
       if (ch == KEY_LIST[i])
-        return (keys_t)i;
+        held[i] = KEY_HOLD_FRAMES;
     }
   }
+
+  uint16_t keys = 0;
+  for (uint32_t i = 0; i < ARRAY_SIZE(held); i++)
+    keys |= (held[i] != 0) << i;
+  return keys;
 }
 
 void sound_beep(void) {
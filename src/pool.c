@@ -0,0 +1,121 @@
+#include "pool.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// indices taken at once, enough to keep the counter off the hot path while
+// still balancing uneven work
+#define POOL_CHUNKS_PER_THREAD (4)
+
+struct pool {
+  pthread_mutex_t lock;
+  pthread_cond_t start; // new job or exit
+  pthread_cond_t done;  // last worker finished
+  uint64_t job;         // bumped for every pool_run
+  uint32_t busy;        // workers still on the current job
+  bool exit;
+
+  pool_fn_t fn;
+  void *ctx;
+  uint32_t count;
+  uint32_t chunk;
+  atomic_uint next;
+
+  uint32_t threads_count; // workers, without the caller
+  pthread_t threads[];
+};
+
+static void pool_work(pool_t *p) {
+  uint32_t start;
+  while ((start = atomic_fetch_add(&p->next, p->chunk)) < p->count) {
+    uint32_t end = start + p->chunk < p->count ? start + p->chunk : p->count;
+    for (uint32_t i = start; i < end; i++)
+      p->fn(p->ctx, i);
+  }
+}
+
+static void *pool_worker(void *arg) {
+  pool_t *p = arg;
+  uint64_t seen = 0;
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (p->job == seen && !p->exit)
+      pthread_cond_wait(&p->start, &p->lock);
+    if (p->exit)
+      break;
+    seen = p->job;
+    pthread_mutex_unlock(&p->lock);
+
+    pool_work(p);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->busy == 0)
+      pthread_cond_signal(&p->done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return nullptr;
+}
+
+pool_t *pool_create(uint32_t threads) {
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  pool_t *p = calloc(1, sizeof(*p) + (threads - 1) * sizeof(*p->threads));
+  if (p == nullptr)
+    return nullptr;
+  pthread_mutex_init(&p->lock, nullptr);
+  pthread_cond_init(&p->start, nullptr);
+  pthread_cond_init(&p->done, nullptr);
+
+  for (; p->threads_count < threads - 1; p->threads_count++) {
+    EXPECT(pthread_create(&p->threads[p->threads_count], nullptr, pool_worker,
+                          p) == 0,
+           ({
+             LOG_ERROR("Failed to start worker %u", p->threads_count);
+             pool_destroy(p);
+             return nullptr;
+           }));
+  }
+  return p;
+}
+
+void pool_destroy(pool_t *p) {
+  if (p == nullptr)
+    return;
+  pthread_mutex_lock(&p->lock);
+  p->exit = true;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+  for (uint32_t t = 0; t < p->threads_count; t++)
+    pthread_join(p->threads[t], nullptr);
+
+  pthread_cond_destroy(&p->done);
+  pthread_cond_destroy(&p->start);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
+
+void pool_run(pool_t *p, uint32_t count, pool_fn_t fn, void *ctx) {
+  uint32_t chunks = (p->threads_count + 1) * POOL_CHUNKS_PER_THREAD;
+  p->fn = fn;
+  p->ctx = ctx;
+  p->count = count;
+  p->chunk = count / chunks ? count / chunks : 1;
+  atomic_store(&p->next, 0);
+
+  pthread_mutex_lock(&p->lock);
+  p->job++;
+  p->busy = p->threads_count;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  pool_work(p); // caller helps out
+
+  pthread_mutex_lock(&p->lock);
+  while (p->busy != 0)
+    pthread_cond_wait(&p->done, &p->lock);
+  pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,110 @@
+#include "render.h"
+#include "frame.h"
+#include "log.h"
+#include "metrics.h"
+#include "stream.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NSEC_PER_FRAME (1'000'000'000 / FRAMES_PER_SECOND)
+// set on MIDDLE by a publish, cleared when the render thread takes the slot
+#define SLOT_FRESH (0x4)
+
+typedef struct {
+  framebuffer_row_t fb[HEIGHT];
+  uint32_t beeps; // bumped whenever the sound timer starts
+  char status[METRICS_STATUS_SIZE];
+} slot_t;
+
+// each slot is owned by one side at a time. the emulation thread fills BACK
+// and swaps it with MIDDLE, the render thread swaps FRONT with MIDDLE when
+// SLOT_FRESH is set. neither ever waits for the other
+static slot_t SLOTS[3];
+static uint8_t BACK = 0;
+static uint8_t FRONT = 1;
+static atomic_uint_least8_t MIDDLE = 2;
+
+static atomic_uint_least16_t KEYS = 0;
+static atomic_bool STOP = false;
+static pthread_t THREAD;
+static bool RUNNING = false;
+
+// emulation side, carried into every slot
+static uint32_t BEEPS = 0;
+static bool SOUND = false;
+static char STATUS[METRICS_STATUS_SIZE] = "";
+
+static bool slot_take(void) {
+  if (!(atomic_load_explicit(&MIDDLE, memory_order_relaxed) & SLOT_FRESH))
+    return false;
+  FRONT = atomic_exchange_explicit(&MIDDLE, FRONT, memory_order_acq_rel) &
+          ~SLOT_FRESH;
+  return true;
+}
+
+static void *render_main(void *) {
+  char status[METRICS_STATUS_SIZE] = "";
+  uint32_t beeps = 0;
+  const struct timespec period = {.tv_nsec = NSEC_PER_FRAME};
+
+  while (!atomic_load_explicit(&STOP, memory_order_relaxed)) {
+    atomic_store_explicit(&KEYS, keyboard_poll(), memory_order_relaxed);
+    if (slot_take()) {
+      const slot_t *s = &SLOTS[FRONT];
+      display_present(s->fb); // keeps what is shown, draws only changes
+      stream_publish(s->fb);
+      if (strcmp(status, s->status) != 0) {
+        display_status(s->status);
+        strcpy(status, s->status);
+      }
+      // one bell per sound however many frames were dropped
+      if (s->beeps != beeps)
+        sound_beep();
+      beeps = s->beeps;
+    }
+    // key holds are counted in polls, keep them at the frame rate
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &period, nullptr);
+  }
+  return nullptr;
+}
+
+int render_start(void) {
+  atomic_store(&STOP, false);
+  EXPECT(pthread_create(&THREAD, nullptr, render_main, nullptr) == 0, ({
+           LOG_ERROR("failed to start render thread");
+           return -1;
+         }));
+  RUNNING = true;
+  return 0;
+}
+
+void render_stop(void) {
+  if (!RUNNING)
+    return;
+  atomic_store(&STOP, true);
+  pthread_join(THREAD, nullptr);
+  RUNNING = false;
+}
+
+void render_publish(const framebuffer_row_t *fb, bool sound,
+                    const char *status) {
+  BEEPS += sound && !SOUND;
+  SOUND = sound;
+  if (status != nullptr)
+    snprintf(STATUS, sizeof(STATUS), "%s", status);
+
+  slot_t *s = &SLOTS[BACK];
+  memcpy(s->fb, fb, sizeof(s->fb));
+  s->beeps = BEEPS;
+  memcpy(s->status, STATUS, sizeof(s->status));
+  BACK = atomic_exchange_explicit(&MIDDLE, BACK | SLOT_FRESH,
+                                  memory_order_acq_rel) &
+         ~SLOT_FRESH;
+}
+
+uint16_t render_keys(void) {
+  return atomic_load_explicit(&KEYS, memory_order_relaxed);
+}
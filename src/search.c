@@ -0,0 +1,281 @@
+#include "search.h"
+#include "log.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SEEN_INITIAL (1 << 16)
+#define STEPS_INITIAL (1 << 10)
+#define NO_STEP (UINT32_MAX)
+
+// one round on the way to a state, routes share their beginnings
+typedef struct {
+  uint32_t parent; // NO_STEP for the first round
+  uint16_t keys;
+} step_t;
+
+typedef struct {
+  chip8_t *m;
+  int64_t score;
+  uint64_t hash;
+  bool stopped; // PC left program memory
+} child_t;
+
+typedef struct {
+  int64_t score;
+  uint32_t index;
+} rank_t;
+
+struct search {
+  search_config_t config;
+  pool_t *pool;
+
+  // config.width machines, the first `width` of them hold the beam
+  uint32_t width;
+  chip8_t **beam;
+  uint32_t *beam_step;
+  int64_t *beam_score;
+  uint32_t *next_step;
+  int64_t *next_score;
+
+  uint32_t children_count;
+  child_t *children;
+  uint64_t explored;
+  rank_t *ranks;
+
+  step_t *steps;
+  uint32_t steps_count;
+  uint32_t steps_capacity;
+
+  // open addressing set of state hashes, 0 marks a free slot
+  uint64_t *seen;
+  uint64_t seen_count;
+  uint64_t seen_capacity; // power of 2
+};
+
+static int64_t score(const search_t *s, const chip8_t *m) {
+  int64_t score = 0;
+  for (uint32_t t = 0; t < s->config.objective_count; t++) {
+    const search_term_t *term = &s->config.objective[t];
+    score += (int64_t)term->weight * chip8_peek(m, term->address);
+  }
+  return score;
+}
+
+static void child_run(void *ctx, uint32_t index) {
+  search_t *s = ctx;
+  child_t *child = &s->children[index];
+  uint32_t parent = index / s->config.actions_count;
+
+  chip8_copy(child->m, s->beam[parent]);
+  chip8_set_keys(child->m,
+                 s->config.actions[index % s->config.actions_count]);
+  child->stopped = false;
+  for (uint32_t f = 0; f < s->config.frames && !child->stopped; f++)
+    child->stopped = chip8_run_frame(child->m) == -1;
+  child->score = score(s, child->m);
+  child->hash = chip8_hash(child->m);
+}
+
+static int seen_grow(search_t *s) {
+  uint64_t capacity = s->seen_capacity ? s->seen_capacity * 2 : SEEN_INITIAL;
+  uint64_t *seen = calloc(capacity, sizeof(*seen));
+  if (seen == nullptr)
+    return -1;
+  for (uint64_t i = 0; i < s->seen_capacity; i++) {
+    uint64_t h = s->seen[i];
+    if (h == 0)
+      continue;
+    uint64_t slot = h & (capacity - 1);
+    while (seen[slot] != 0)
+      slot = (slot + 1) & (capacity - 1);
+    seen[slot] = h;
+  }
+  free(s->seen);
+  s->seen = seen;
+  s->seen_capacity = capacity;
+  return 0;
+}
+
+// false if `hash` was there already
+static bool seen_insert(search_t *s, uint64_t hash) {
+  hash = hash ? hash : 1;
+  uint64_t slot = hash & (s->seen_capacity - 1);
+  for (; s->seen[slot] != 0; slot = (slot + 1) & (s->seen_capacity - 1)) {
+    if (s->seen[slot] == hash)
+      return false;
+  }
+  s->seen[slot] = hash;
+  s->seen_count++;
+  return true;
+}
+
+static uint32_t step_add(search_t *s, uint32_t parent, uint16_t keys) {
+  if (s->steps_count == s->steps_capacity) {
+    uint32_t capacity = s->steps_capacity ? s->steps_capacity * 2
+                                          : STEPS_INITIAL;
+    step_t *steps = realloc(s->steps, capacity * sizeof(*steps));
+    if (steps == nullptr)
+      return NO_STEP;
+    s->steps = steps;
+    s->steps_capacity = capacity;
+  }
+  s->steps[s->steps_count] = (step_t){parent, keys};
+  return s->steps_count++;
+}
+
+// best score first, ties go to the earlier child so rounds are reproducible
+static int rank_compare(const void *a, const void *b) {
+  const rank_t *x = a, *y = b;
+  if (x->score != y->score)
+    return x->score < y->score ? 1 : -1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+search_t *search_create(const chip8_t *start, const search_config_t *c) {
+  EXPECT(c->width > 0 && c->actions_count <= SEARCH_MAX_ACTIONS &&
+             c->objective_count <= SEARCH_MAX_TERMS,
+         ({ return nullptr; }));
+  search_t *s = calloc(1, sizeof(*s));
+  if (s == nullptr)
+    return nullptr;
+  s->config = *c;
+  s->config.frames = c->frames ? c->frames : 1;
+  if (c->actions_count == 0) {
+    s->config.actions_count = 17;
+    s->config.actions[0] = 0; // no keys
+    for (uint32_t k = 0; k < 16; k++)
+      s->config.actions[k + 1] = 1 << k;
+  }
+  uint32_t width = s->config.width;
+  s->children_count = width * s->config.actions_count;
+
+  s->pool = pool_create(c->threads);
+  s->beam = calloc(width, sizeof(*s->beam));
+  s->beam_step = calloc(width, sizeof(*s->beam_step));
+  s->beam_score = calloc(width, sizeof(*s->beam_score));
+  s->next_step = calloc(width, sizeof(*s->next_step));
+  s->next_score = calloc(width, sizeof(*s->next_score));
+  s->children = calloc(s->children_count, sizeof(*s->children));
+  s->ranks = calloc(s->children_count, sizeof(*s->ranks));
+  if (s->pool == nullptr || s->beam == nullptr || s->beam_step == nullptr ||
+      s->beam_score == nullptr || s->next_step == nullptr ||
+      s->next_score == nullptr || s->children == nullptr ||
+      s->ranks == nullptr || seen_grow(s) == -1)
+    goto err;
+  for (uint32_t i = 0; i < width; i++) {
+    if ((s->beam[i] = chip8_create(0)) == nullptr)
+      goto err;
+  }
+  for (uint32_t i = 0; i < s->children_count; i++) {
+    if ((s->children[i].m = chip8_create(0)) == nullptr)
+      goto err;
+  }
+
+  chip8_copy(s->beam[0], start);
+  s->width = 1;
+  s->beam_step[0] = NO_STEP;
+  s->beam_score[0] = score(s, start);
+  seen_insert(s, chip8_hash(start));
+  return s;
+err:
+  LOG_ERROR("Failed to create search %u states wide", c->width);
+  search_destroy(s);
+  return nullptr;
+}
+
+void search_destroy(search_t *s) {
+  if (s == nullptr)
+    return;
+  for (uint32_t i = 0; s->beam != nullptr && i < s->config.width; i++)
+    chip8_destroy(s->beam[i]);
+  for (uint32_t i = 0; s->children != nullptr && i < s->children_count; i++)
+    chip8_destroy(s->children[i].m);
+  pool_destroy(s->pool);
+  free(s->beam);
+  free(s->beam_step);
+  free(s->beam_score);
+  free(s->next_step);
+  free(s->next_score);
+  free(s->children);
+  free(s->ranks);
+  free(s->steps);
+  free(s->seen);
+  free(s);
+}
+
+uint32_t search_round(search_t *s) {
+  uint32_t count = s->width * s->config.actions_count;
+  pool_run(s->pool, count, child_run, s);
+  s->explored += count;
+
+  uint32_t ranks_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!s->children[i].stopped)
+      s->ranks[ranks_count++] = (rank_t){s->children[i].score, i};
+  }
+  qsort(s->ranks, ranks_count, sizeof(*s->ranks), rank_compare);
+
+  // routes of the kept children first, parents are still in place
+  uint32_t kept = 0;
+  for (uint32_t r = 0; r < ranks_count && kept < s->config.width; r++) {
+    child_t *child = &s->children[s->ranks[r].index];
+    if (s->seen_count * 2 >= s->seen_capacity && seen_grow(s) == -1)
+      break;
+    if (!seen_insert(s, child->hash))
+      continue;
+    uint32_t parent = s->ranks[r].index / s->config.actions_count;
+    uint32_t step = step_add(
+        s, s->beam_step[parent],
+        s->config.actions[s->ranks[r].index % s->config.actions_count]);
+    EXPECT(step != NO_STEP, ({
+             LOG_ERROR("Out of memory for routes after %u rounds",
+                       s->steps_count);
+             break;
+           }));
+    s->next_step[kept] = step;
+    s->next_score[kept] = child->score;
+    s->ranks[kept++].index = s->ranks[r].index;
+  }
+  if (kept == 0)
+    return 0;
+
+  // kept children trade machines with the old beam, nothing is copied
+  for (uint32_t n = 0; n < kept; n++) {
+    child_t *child = &s->children[s->ranks[n].index];
+    chip8_t *m = s->beam[n];
+    s->beam[n] = child->m;
+    child->m = m;
+    s->beam_step[n] = s->next_step[n];
+    s->beam_score[n] = s->next_score[n];
+  }
+  s->width = kept;
+  return kept;
+}
+
+uint32_t search_width(const search_t *s) { return s->width; }
+
+const chip8_t *search_state(const search_t *s, uint32_t rank) {
+  return s->beam[rank];
+}
+
+int64_t search_score(const search_t *s, uint32_t rank) {
+  return s->beam_score[rank];
+}
+
+uint32_t search_route(const search_t *s, uint32_t rank, uint16_t *keys,
+                      uint32_t max) {
+  uint32_t rounds = 0;
+  for (uint32_t i = s->beam_step[rank]; i != NO_STEP; i = s->steps[i].parent)
+    rounds++;
+  uint32_t r = rounds;
+  for (uint32_t i = s->beam_step[rank]; i != NO_STEP; i = s->steps[i].parent) {
+    if (--r < max)
+      keys[r] = s->steps[i].keys;
+  }
+  return rounds;
+}
+
+uint64_t search_visited(const search_t *s) { return s->seen_count; }
+
+uint64_t search_explored(const search_t *s) { return s->explored; }
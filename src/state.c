@@ -1,27 +1,81 @@
+#define _GNU_SOURCE // memfd_create
 #include "state.h"
+#include "decode.h"
 #include "log.h"
 #include "periph.h"
 #include "utils.h"
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
-state_t STATE = {};
+thread_local state_t STATE = {};
 
-static int state_load_program(FILE *prog) {
-  address_t program_size, avaliable_size;
-  avaliable_size = (address_t){sizeof(STATE.mmap->memory)};
+extern inline void state_memory_dirty(address_t a, uint32_t size);
+
+// maps one memfd twice back to back, the second view is the mirror
+static uint8_t *memory_mirror(void) {
+  int fd = memfd_create("chip8", MFD_CLOEXEC);
+  if (fd == -1)
+    return nullptr;
+  uint8_t *base = mmap(nullptr, 2 * MEMORY_SIZE, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  bool ok = ftruncate(fd, MEMORY_SIZE) == 0 && base != MAP_FAILED;
+  for (uint32_t view = 0; ok && view < 2; view++)
+    ok = mmap(base + view * MEMORY_SIZE, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+  close(fd);
+  if (ok)
+    return base;
+  if (base != MAP_FAILED)
+    munmap(base, 2 * MEMORY_SIZE);
+  return nullptr;
+}
+
+void *state_memory_alloc(void) {
+  long page = sysconf(_SC_PAGESIZE);
+  EXPECT(page >= MEMORY_SIZE, ({ return nullptr; }));
+  if (page == MEMORY_SIZE) {
+    uint8_t *memory = memory_mirror();
+    if (memory != nullptr)
+      return memory;
+  }
+
+  // memory is the tail of the first page, second one is the guard
+  uint8_t *base = mmap(nullptr, 2 * page, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    return nullptr;
+  if (mprotect(base, page, PROT_READ | PROT_WRITE) == -1) {
+    munmap(base, 2 * page);
+    return nullptr;
+  }
+  return base + page - MEMORY_SIZE;
+}
+
+void state_memory_free(void *memory) {
+  if (memory == nullptr)
+    return;
+  // both layouts take two pages and end memory at the first page boundary
+  long page = sysconf(_SC_PAGESIZE);
+  munmap((uint8_t *)memory - (page - MEMORY_SIZE), 2 * page);
+}
+
+int state_load_program(FILE *prog) {
+  // program goes at PC, which `-s` may have moved past PROGRAM_START
+  EXPECT(STATE.registers.PC.v < AVALIABLE_MEMORY_END, ({ return -1; }));
+  long avaliable_size = AVALIABLE_MEMORY_END - STATE.registers.PC.v;
 
   fseek(prog, 0, SEEK_END); // seek to end of file
-  program_size = (address_t){ftell(prog)};
+  long program_size = ftell(prog);
   fseek(prog, 0, SEEK_SET); // seek back to beginning of file
 
-  EXPECT(program_size.v >= 0 && program_size.v <= avaliable_size.v,
+  EXPECT(program_size >= 0 && program_size <= avaliable_size,
          ({ return -1; }));
-  EXPECT(fread((uint8_t *)STATE.mmap + STATE.registers.PC.v,
-               sizeof(*STATE.mmap->memory), avaliable_size.v, prog) != 0,
+  EXPECT(fread(state_memory_pointer(STATE.registers.PC),
+               sizeof(*STATE.mmap->memory), program_size, prog) != 0,
          ({ return -1; }));
+  decode_flush();
   return 0;
 }
 
@@ -54,24 +108,18 @@ void state_reset(instructions_per_second_t ips, address_t program_start) {
   }
 
   STATE.nest = 0;
+  STATE.keys = 0;
+  STATE.key_wait = 0;
+  STATE.cycles_rest = 0;
+  STATE.frame_left = 0;
+  STATE.rng = RNG_SEED;
+  decode_flush(); // sprites may have been overwritten
   STATE.ips = ips;
   STATE.registers.PC = program_start;
   STATE.registers.SP = (sp_t){STACK_START};
   LOG_INFO("STATE was reinitialized");
 }
 
-int state_init(instructions_per_second_t ips, address_t program_start, FILE *prog) {
-  STATE.mmap = calloc(1, MEMORY_SIZE);
-  EXPECT(STATE.mmap != nullptr, ({ LOG_PANIC("Failed to malloc memory"); }));
-  state_reset(ips, program_start);
-  EXPECT(state_load_program(prog) != -1, ({
-           LOG_ERROR("Failed to read program");
-           return -1;
-         }));
-  LOG_STATE();
-  return 0;
-}
-
 address_t state_sp_ld(void) {
   if (STATE.registers.SP.v >= STACK_START)
     return STATE.registers.PC;
@@ -87,5 +135,6 @@ void state_sp_str(address_t offset) {
 
   address_t *p = state_memory_pointer(STATE.registers.SP);
   *p = offset;
+  state_memory_dirty(STATE.registers.SP, sizeof(*p));
   STATE.registers.SP.v -= sizeof(STATE.registers.SP);
 }
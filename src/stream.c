@@ -0,0 +1,131 @@
+#include "stream.h"
+#include "log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct {
+  stream_header_t header;
+  framebuffer_row_t rows[HEIGHT];
+} message_t;
+
+static int LISTENER = -1;
+static int CLIENTS[STREAM_MAX_CLIENTS];
+static uint32_t CLIENTS_COUNT = 0;
+static uint32_t FRAME = 0;
+static framebuffer_row_t PUBLISHED[HEIGHT]; // what spectators have
+static char PATH[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+int stream_init(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  EXPECT(strlen(path) < sizeof(addr.sun_path), ({
+           LOG_ERROR("socket path is too long: %s", path);
+           return -1;
+         }));
+  strcpy(addr.sun_path, path);
+
+  LISTENER = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  EXPECT(LISTENER != -1, ({
+           LOG_ERROR("socket failed: %s", strerror(errno));
+           return -1;
+         }));
+
+  unlink(path); // stale socket from previous run
+  EXPECT(bind(LISTENER, (struct sockaddr *)&addr, sizeof(addr)) != -1 &&
+             listen(LISTENER, STREAM_MAX_CLIENTS) != -1,
+         ({
+           LOG_ERROR("failed to listen on %s: %s", path, strerror(errno));
+           goto err;
+         }));
+
+  strcpy(PATH, path);
+  memset(PUBLISHED, 0, sizeof(PUBLISHED));
+  LOG_INFO("streaming to %s", path);
+  return 0;
+
+err:
+  close(LISTENER);
+  LISTENER = -1;
+  return -1;
+}
+
+void stream_exit(void) {
+  if (LISTENER == -1)
+    return;
+  for (uint32_t i = 0; i < CLIENTS_COUNT; i++)
+    close(CLIENTS[i]);
+  CLIENTS_COUNT = 0;
+  close(LISTENER);
+  LISTENER = -1;
+  unlink(PATH);
+}
+
+static size_t message_build(message_t *m, const framebuffer_row_t *prev,
+                            const framebuffer_row_t *cur) {
+  m->header = (stream_header_t){STREAM_MAGIC, FRAME, 0};
+  uint32_t n = 0;
+  for (uint32_t y = 0; y < HEIGHT; y++) {
+    if (memcmp(prev[y], cur[y], FRAMEBUFFER_PITCH) == 0)
+      continue;
+    for (uint32_t b = 0; b < FRAMEBUFFER_PITCH; b++)
+      m->rows[n][b] = prev[y][b] ^ cur[y][b];
+    m->header.rows |= (uint32_t)1 << y;
+    n++;
+  }
+  return sizeof(m->header) + n * sizeof(*m->rows);
+}
+
+// whole message or nothing, partial write would desync the spectator
+static bool client_send(int fd, const message_t *m, size_t size) {
+  ssize_t sent = send(fd, m, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+  return sent == (ssize_t)size;
+}
+
+static void client_drop(uint32_t i) {
+  LOG_INFO("dropping spectator %d", CLIENTS[i]);
+  close(CLIENTS[i]);
+  CLIENTS[i] = CLIENTS[--CLIENTS_COUNT];
+}
+
+static void clients_accept(void) {
+  static const framebuffer_row_t BLANK[HEIGHT] = {};
+  message_t m;
+  size_t size = 0;
+
+  int fd;
+  // no need for O_NONBLOCK on spectators, every send is MSG_DONTWAIT
+  while ((fd = accept(LISTENER, nullptr, nullptr)) != -1) {
+    if (size == 0)
+      size = message_build(&m, BLANK, PUBLISHED);
+    if (CLIENTS_COUNT == STREAM_MAX_CLIENTS || !client_send(fd, &m, size)) {
+      LOG_WARN("refusing spectator %d", fd);
+      close(fd);
+      continue;
+    }
+    LOG_INFO("new spectator %d", fd);
+    CLIENTS[CLIENTS_COUNT++] = fd;
+  }
+}
+
+void stream_publish(const framebuffer_row_t *fb) {
+  if (LISTENER == -1)
+    return;
+
+  clients_accept();
+  FRAME++;
+  if (memcmp(PUBLISHED, fb, sizeof(PUBLISHED)) == 0)
+    return;
+
+  message_t m;
+  size_t size = message_build(&m, PUBLISHED, fb);
+  memcpy(PUBLISHED, fb, sizeof(PUBLISHED));
+  for (uint32_t i = 0; i < CLIENTS_COUNT;) {
+    if (client_send(CLIENTS[i], &m, size))
+      i++;
+    else
+      client_drop(i); // swaps last client into `i`
+  }
+}
@@ -0,0 +1,81 @@
+#include "trap.h"
+
+static bool cond_holds(chip8_cond_t c) {
+  uint8_t v = *state_register_value(c.reg & 0xF);
+  switch (c.op) {
+  case CHIP8_COND_ALWAYS:
+    return true;
+  case CHIP8_COND_EQ:
+    return v == c.value;
+  case CHIP8_COND_NE:
+    return v != c.value;
+  case CHIP8_COND_LT:
+    return v < c.value;
+  case CHIP8_COND_GT:
+    return v > c.value;
+  }
+  return true;
+}
+
+// bytes an FX33 or FX55 at PC is about to write, 0 for anything else
+static uint32_t store_size(const decoded_t *d) {
+  if (d->op == OP_LD_B)
+    return 3;
+  if (d->op == OP_LD_I_VX)
+    return REGISTER_FROM(d->words[0], 2) + 1;
+  return 0;
+}
+
+bool trap_at(uint16_t pc, opcode_t op) {
+  const traps_t *t = STATE.traps;
+  if (t->watchpoints_count != 0 && (op == OP_LD_B || op == OP_LD_I_VX))
+    return true;
+  for (uint32_t b = 0; b < t->breakpoints_count; b++) {
+    if (t->breakpoints[b].address == pc)
+      return true;
+  }
+  return false;
+}
+
+bool trap_hit(const decoded_t *d, uint16_t pc) {
+  traps_t *t = STATE.traps;
+  // the first trap after resuming is that one unless it was removed since
+  bool resumed = t->resume && pc == t->resume_pc;
+  t->resume = false;
+  if (resumed)
+    return false;
+
+  for (uint32_t b = 0; b < t->breakpoints_count; b++) {
+    const breakpoint_t *bp = &t->breakpoints[b];
+    if (bp->address == pc && cond_holds(bp->cond)) {
+      t->stop = CHIP8_STOP_BREAKPOINT;
+      t->stop_where = pc;
+      return true;
+    }
+  }
+
+  // stores wrap past 0xFFF like the memory does
+  uint32_t size = store_size(d);
+  uint16_t I = STATE.registers.I.v;
+  for (uint32_t w = 0; w < t->watchpoints_count && size != 0; w++) {
+    const watchpoint_t *wp = &t->watchpoints[w];
+    uint32_t into_store = (wp->address + MEMORY_SIZE - I) % MEMORY_SIZE;
+    uint32_t into_watch = (I + MEMORY_SIZE - wp->address) % MEMORY_SIZE;
+    if (into_store < size || into_watch < wp->size) {
+      t->stop = CHIP8_STOP_WATCHPOINT;
+      t->stop_where = wp->address;
+      return true;
+    }
+  }
+  return false;
+}
+
+void trap_resume(void) {
+  traps_t *t = STATE.traps;
+  if (t == nullptr || t->stop == CHIP8_STOP_NONE)
+    return;
+  // stopped right before the trap at PC, it is the next thing to run
+  t->resume = true;
+  t->resume_pc = STATE.registers.PC.v;
+  t->stop = CHIP8_STOP_NONE;
+}
@@ -0,0 +1,181 @@
+// static analysis of a ROM: listing, control-flow graph and code map
+#include "analyze.h"
+#include "decode.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DATA_PER_LINE (8)
+
+typedef enum : uint8_t {
+  OUTPUT_LISTING,
+  OUTPUT_DOT,
+  OUTPUT_JSON,
+} output_t;
+
+static uint8_t MEMORY[MEMORY_SIZE];
+static analysis_t ANALYSIS;
+
+static int fclose_cleanup(FILE **f) { return *f ? fclose(*f) : 0; }
+
+static bool block_start(uint16_t pc) {
+  for (uint32_t b = 0; b < ANALYSIS.blocks_count; b++) {
+    if (ANALYSIS.blocks[b].start == pc)
+      return true;
+  }
+  return false;
+}
+
+static void listing_print(uint16_t start, uint16_t end) {
+  char text[32];
+  for (uint16_t pc = start; pc < end;) {
+    if (ANALYSIS.map[pc] == BYTE_CODE) {
+      instruction_t i = MEMORY[pc] << 8 | MEMORY[(pc + 1) % MEMORY_SIZE];
+      decode_format(i, text, sizeof(text));
+      if (block_start(pc))
+        printf("L%03X:\n", pc);
+      printf("  %03X: %04X  %s\n", pc, i, text);
+      pc += INSTRUCTION_SIZE;
+      continue;
+    }
+
+    // run of bytes of the same kind
+    uint16_t run = pc;
+    while (run < end && run - pc < DATA_PER_LINE &&
+           ANALYSIS.map[run] == ANALYSIS.map[pc])
+      run++;
+    printf("  %03X: DB   ", pc);
+    for (uint16_t b = pc; b < run; b++)
+      printf(" %02X", MEMORY[b]);
+    printf("%*s ; %s\n", (DATA_PER_LINE - (run - pc)) * 3, "",
+           ANALYSIS.map[pc] == BYTE_DATA ? "data" : "unreached");
+    pc = run;
+  }
+}
+
+static void dot_print(void) {
+  printf("digraph cfg {\n  node [shape=box fontname=monospace];\n");
+  for (uint32_t b = 0; b < ANALYSIS.blocks_count; b++) {
+    const block_t *block = &ANALYSIS.blocks[b];
+    printf("  L%03X [label=\"%03X-%03X\"];\n", block->start, block->start,
+           block->end - (uint32_t)INSTRUCTION_SIZE);
+    for (uint32_t n = 0; n < ARRAY_SIZE(block->next); n++) {
+      if (block->next[n] != ANALYZE_NONE)
+        printf("  L%03X -> L%03X;\n", block->start, block->next[n]);
+    }
+  }
+  printf("}\n");
+}
+
+// prints [start, end) ranges of bytes of kind `a` or `b`
+static void ranges_print(const char *name, byte_kind_t a, byte_kind_t b) {
+  printf("  \"%s\": [", name);
+  const char *sep = "";
+  for (uint32_t pc = 0; pc < MEMORY_SIZE;) {
+    if (ANALYSIS.map[pc] != a && ANALYSIS.map[pc] != b) {
+      pc++;
+      continue;
+    }
+    uint32_t end = pc;
+    while (end < MEMORY_SIZE &&
+           (ANALYSIS.map[end] == a || ANALYSIS.map[end] == b))
+      end++;
+    printf("%s[%u, %u]", sep, pc, end);
+    sep = ", ";
+    pc = end;
+  }
+  printf("],\n");
+}
+
+static void json_print(void) {
+  printf("{\n  \"entry\": %u,\n", ANALYSIS.entry.v);
+  ranges_print("code", BYTE_CODE, BYTE_OPERAND);
+  ranges_print("data", BYTE_DATA, BYTE_DATA);
+
+  printf("  \"written_pages\": [");
+  const char *sep = "";
+  for (uint32_t p = 0; p < MEMORY_SIZE / ANALYZE_PAGE_SIZE; p++) {
+    if (ANALYSIS.written_pages & (1 << p)) {
+      printf("%s%u", sep, p);
+      sep = ", ";
+    }
+  }
+  printf("],\n  \"written_unknown\": %s,\n  \"indirect\": %s,\n",
+         ANALYSIS.written_unknown ? "true" : "false",
+         ANALYSIS.indirect ? "true" : "false");
+
+  printf("  \"blocks\": [\n");
+  for (uint32_t b = 0; b < ANALYSIS.blocks_count; b++) {
+    const block_t *block = &ANALYSIS.blocks[b];
+    printf("    {\"start\": %u, \"end\": %u, \"next\": [", block->start,
+           block->end);
+    sep = "";
+    for (uint32_t n = 0; n < ARRAY_SIZE(block->next); n++) {
+      if (block->next[n] != ANALYZE_NONE) {
+        printf("%s%u", sep, block->next[n]);
+        sep = ", ";
+      }
+    }
+    printf("]}%s\n", b + 1 == ANALYSIS.blocks_count ? "" : ",");
+  }
+  printf("  ]\n}\n");
+}
+
+static int usage(const char *name) {
+  printf("usage: %s [-g | -j] [-s start] <rom>\n"
+         "  default listing, -g graphviz control-flow graph, -j json code "
+         "map\n",
+         name);
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  output_t output = OUTPUT_LISTING;
+  address_t start = {PROGRAM_START};
+  char option;
+  while ((option = getopt(argc, argv, "gjs:")) != -1) {
+    switch (option) {
+    case 'g':
+      output = OUTPUT_DOT;
+      break;
+    case 'j':
+      output = OUTPUT_JSON;
+      break;
+    case 's': {
+      char *end = nullptr;
+      long res = strtol(optarg, &end, 0);
+      if (*end != '\0' || res < 0 || res >= (long)AVALIABLE_MEMORY_END)
+        return usage(argv[0]);
+      start.v = res;
+      break;
+    }
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    return usage(argv[0]);
+
+  [[gnu::cleanup(fclose_cleanup)]] FILE *rom = fopen(argv[optind], "rb");
+  EXPECT(rom != nullptr, ({
+           printf("Failed to read program %s\n", argv[optind]);
+           return EXIT_FAILURE;
+         }));
+  size_t size = fread(MEMORY + start.v, 1, MEMORY_SIZE - start.v, rom);
+
+  analyze(MEMORY, start, &ANALYSIS);
+  switch (output) {
+  case OUTPUT_LISTING:
+    listing_print(start.v, start.v + size);
+    break;
+  case OUTPUT_DOT:
+    dot_print();
+    break;
+  case OUTPUT_JSON:
+    json_print();
+    break;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+// steps a batch of machines through the vector env for a while and reports
+// how many frames a second they ran
+#include "env.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ROM_SIZE (4096)
+
+static int fclose_cleanup(FILE **f) { return *f ? fclose(*f) : 0; }
+static void free_cleanup(void *p) { free(*(void **)p); }
+static void env_cleanup(env_t **e) { env_destroy(*e); }
+
+static int usage(const char *name) {
+  printf("usage: %s [-n machines] [-t threads] [-s steps] [-i ips] <rom>\n",
+         name);
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t count = 256, steps = 1000;
+  env_config_t config = {.ips = 1000};
+  char option;
+  while ((option = getopt(argc, argv, "n:t:s:i:")) != -1) {
+    switch (option) {
+    case 'n':
+      count = strtoul(optarg, nullptr, 10);
+      break;
+    case 't':
+      config.threads = strtoul(optarg, nullptr, 10);
+      break;
+    case 's':
+      steps = strtoul(optarg, nullptr, 10);
+      break;
+    case 'i':
+      config.ips = strtoul(optarg, nullptr, 10);
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || count == 0)
+    return usage(argv[0]);
+
+  [[gnu::cleanup(fclose_cleanup)]] FILE *f = fopen(argv[optind], "rb");
+  EXPECT(f != nullptr, ({
+           printf("Failed to read program %s\n", argv[optind]);
+           return EXIT_FAILURE;
+         }));
+  uint8_t rom[MAX_ROM_SIZE];
+  config.rom = rom;
+  config.rom_size = fread(rom, sizeof(*rom), sizeof(rom), f);
+
+  [[gnu::cleanup(env_cleanup)]] env_t *e = env_create(count, &config);
+  [[gnu::cleanup(free_cleanup)]] env_observation_t *obs =
+      calloc(count, sizeof(*obs));
+  [[gnu::cleanup(free_cleanup)]] uint16_t *actions =
+      calloc(count, sizeof(*actions));
+  [[gnu::cleanup(free_cleanup)]] int32_t *rewards =
+      calloc(count, sizeof(*rewards));
+  [[gnu::cleanup(free_cleanup)]] bool *dones = calloc(count, sizeof(*dones));
+  EXPECT(e != nullptr && obs != nullptr && actions != nullptr &&
+             rewards != nullptr && dones != nullptr,
+         ({
+           printf("Failed to create %u machines\n", count);
+           return EXIT_FAILURE;
+         }));
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  env_reset(e, obs);
+  for (uint32_t s = 0; s < steps; s++) {
+    for (uint32_t i = 0; i < count; i++)
+      actions[i] = rand() & 0xFFFF; // mash every key
+    env_step(e, actions, obs, rewards, dones);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%u machines, %u steps in %.2fs, %.0f frames/s\n", count, steps,
+         seconds, (double)count * steps / seconds);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,282 @@
+// runs the reference core (execute() straight from memory) and the fast core
+// (predecoded and fused, execute_cached()) side by side on the same ROM and
+// keys. after every dispatch of the fast core, the reference catches up by
+// as many instructions and both machines are compared. with -s the fast core
+// runs whole frames of frame_run(), idle loops skipped, and both are compared
+// after every frame
+#include "decode.h"
+#include "frame.h"
+#include "instructions.h"
+#include "log.h"
+#include "state.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_HISTORY (1024)
+#define KEY_HOLD_FRAMES (8) // random keys change this often
+#define ROW "  %-8s  %-18s  %s\n"
+
+typedef struct {
+  uint64_t n; // instructions before this one
+  pc_t pc;
+  instruction_t i;
+} trace_t;
+
+static state_t REF, FAST;
+static trace_t HISTORY[MAX_HISTORY];
+static uint32_t HISTORY_SIZE = 32;
+static uint64_t RETIRED = 0;
+
+static int fclose_cleanup(FILE **f) { return *f ? fclose(*f) : 0; }
+
+static int machine_init(state_t *s, bool fast, instructions_per_second_t ips,
+                        FILE *rom) {
+  STATE = (state_t){};
+  STATE.mmap = state_memory_alloc();
+  STATE.cache = fast ? calloc(DECODE_CACHE, sizeof(*STATE.cache)) : nullptr;
+  if (STATE.mmap == nullptr || (fast && STATE.cache == nullptr))
+    return -1;
+  state_reset(ips, (address_t){PROGRAM_START});
+  fseek(rom, 0, SEEK_SET);
+  int res = state_load_program(rom);
+  *s = STATE;
+  return res;
+}
+
+static inline instruction_t fetch(pc_t pc) {
+  const uint8_t *memory = state_memory_pointer(pc);
+  return memory[0] << 8 | memory[1];
+}
+
+static void reference_run(uint32_t n) {
+  STATE = REF;
+  for (; n != 0; n--, RETIRED++) {
+    instruction_t i = fetch(STATE.registers.PC);
+    HISTORY[RETIRED % HISTORY_SIZE] = (trace_t){RETIRED, STATE.registers.PC, i};
+    execute(i);
+    STATE.retired++;
+  }
+  REF = STATE;
+}
+
+static uint32_t fast_run(uint32_t left) {
+  STATE = FAST;
+  uint32_t n = execute_cached(left);
+  STATE.retired += n;
+  FAST = STATE;
+  return n;
+}
+
+// one frame of frame_run() with idle loops skipped. returns what it does
+static int fast_frame(void) {
+  STATE = FAST;
+  int res = frame_run();
+  FAST = STATE;
+  return res;
+}
+
+// one frame with the budget of frame_run(), every instruction run. returns -1
+// once PC leaves program memory
+static int reference_frame(void) {
+  uint32_t ips = REF.ips ? REF.ips : IPS_UNLIMITED;
+  uint32_t left = (ips + REF.cycles_rest) / FRAMES_PER_SECOND;
+  REF.cycles_rest = (ips + REF.cycles_rest) % FRAMES_PER_SECOND;
+  for (; left != 0; left--) {
+    if (REF.registers.PC.v >= AVALIABLE_MEMORY_END)
+      return -1;
+    reference_run(1);
+  }
+  REF.timers.delay -= REF.timers.delay != 0;
+  REF.timers.sound -= REF.timers.sound != 0;
+  return 0;
+}
+
+static uint64_t memory_hash(const state_t *s) {
+  uint64_t h = 0xcbf29ce484222325; // FNV-1a
+  const uint8_t *p = (const uint8_t *)s->mmap;
+  for (uint32_t i = 0; i < MEMORY_SIZE; i++)
+    h = (h ^ p[i]) * 0x100000001b3;
+  return h;
+}
+
+// prints a row for every field that differs, returns how many did
+static uint32_t compare(bool print) {
+  uint32_t differ = 0;
+#define FIELD(name, fmt, a, b)                                                 \
+  do {                                                                         \
+    if ((a) == (b))                                                            \
+      break;                                                                   \
+    differ++;                                                                  \
+    char ref[24], fast[24];                                                    \
+    snprintf(ref, sizeof(ref), fmt, a);                                        \
+    snprintf(fast, sizeof(fast), fmt, b);                                      \
+    if (print)                                                                 \
+      printf(ROW, name, ref, fast);                                            \
+  } while (0)
+
+  const gp_register_value_t *ref_v = &REF.registers.V0;
+  const gp_register_value_t *fast_v = &FAST.registers.V0;
+  static const char *const V[] = {"V0", "V1", "V2", "V3", "V4", "V5",
+                                  "V6", "V7", "V8", "V9", "VA", "VB",
+                                  "VC", "VE", "VD", "VF"};
+  for (uint32_t r = REG_V0; r <= REG_VF; r++)
+    FIELD(V[r], "0x%02X", ref_v[r], fast_v[r]);
+  FIELD("I", "0x%03X", REF.registers.I.v, FAST.registers.I.v);
+  FIELD("PC", "0x%03X", REF.registers.PC.v, FAST.registers.PC.v);
+  FIELD("SP", "0x%03X", REF.registers.SP.v, FAST.registers.SP.v);
+  FIELD("DT", "%u", REF.timers.delay, FAST.timers.delay);
+  FIELD("ST", "%u", REF.timers.sound, FAST.timers.sound);
+  FIELD("nest", "%u", REF.nest, FAST.nest);
+  FIELD("key_wait", "%u", REF.key_wait, FAST.key_wait);
+  FIELD("rng", "0x%08X", REF.rng, FAST.rng);
+  FIELD("retired", "%" PRIu64, REF.retired, FAST.retired);
+  FIELD("rest", "%u", REF.cycles_rest, FAST.cycles_rest);
+#undef FIELD
+
+  // framebuffer is part of memory, told apart in the report
+  const uint8_t *ref_m = (const uint8_t *)REF.mmap;
+  const uint8_t *fast_m = (const uint8_t *)FAST.mmap;
+  if (memcmp(ref_m, fast_m, MEMORY_SIZE) != 0) {
+    differ++;
+    if (print) {
+      uint32_t a = 0;
+      while (ref_m[a] == fast_m[a])
+        a++;
+      char ref[32], fast[32];
+      snprintf(ref, sizeof(ref), "%016" PRIx64, memory_hash(&REF));
+      snprintf(fast, sizeof(fast), "%016" PRIx64, memory_hash(&FAST));
+      printf(ROW, "memory", ref, fast);
+      printf("  first difference at 0x%03X%s\n", a,
+             a >= offsetof(typeof(*STATE.mmap), display_refresh)
+                 ? ", in the framebuffer"
+                 : "");
+    }
+  }
+  return differ;
+}
+
+static void report(uint32_t frame) {
+  printf("cores differ after %" PRIu64 " instructions, in frame %u\n",
+         RETIRED, frame);
+  printf(ROW, "field", "reference", "fast");
+  compare(true);
+
+  printf("last instructions of the reference:\n");
+  uint64_t first = RETIRED > HISTORY_SIZE ? RETIRED - HISTORY_SIZE : 0;
+  char text[32];
+  for (uint64_t n = first; n < RETIRED; n++) {
+    const trace_t *t = &HISTORY[n % HISTORY_SIZE];
+    decode_format(t->i, text, sizeof(text));
+    printf("  %8" PRIu64 "  %03X: %04X  %s\n", t->n, t->pc.v, t->i, text);
+  }
+}
+
+static int usage(const char *name) {
+  printf("usage: %s [-f frames] [-i ips] [-k seed] [-n history] [-s] <rom>\n"
+         "  -k presses random keys, 0 presses none\n"
+         "  -s compares whole frames, the fast core skips idle loops\n",
+         name);
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t frames = 600, seed = 0;
+  bool frames_only = false;
+  instructions_per_second_t ips = DEFAULT_IPS;
+  char option;
+  while ((option = getopt(argc, argv, "f:i:k:n:s")) != -1) {
+    switch (option) {
+    case 'f':
+      frames = strtoul(optarg, nullptr, 10);
+      break;
+    case 'i':
+      ips = strtoul(optarg, nullptr, 10);
+      break;
+    case 'k':
+      seed = strtoul(optarg, nullptr, 10);
+      break;
+    case 'n':
+      HISTORY_SIZE = strtoul(optarg, nullptr, 10);
+      if (HISTORY_SIZE == 0 || HISTORY_SIZE > MAX_HISTORY)
+        return usage(argv[0]);
+      break;
+    case 's':
+      frames_only = true;
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    return usage(argv[0]);
+
+  [[gnu::cleanup(fclose_cleanup)]] FILE *rom = fopen(argv[optind], "rb");
+  EXPECT(rom != nullptr, ({
+           printf("Failed to read program %s\n", argv[optind]);
+           return EXIT_FAILURE;
+         }));
+  EXPECT(machine_init(&REF, false, ips, rom) != -1 &&
+             machine_init(&FAST, true, ips, rom) != -1,
+         ({
+           printf("Failed to load %s\n", argv[optind]);
+           return EXIT_FAILURE;
+         }));
+
+  uint32_t rate = ips ? ips : IPS_UNLIMITED, rest = 0;
+  uint16_t keys = 0;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    if (seed != 0 && frame % KEY_HOLD_FRAMES == 0) {
+      seed ^= seed << 13; // xorshift32, like CXNN
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      keys = seed;
+    }
+    REF.keys = FAST.keys = keys;
+
+    if (frames_only) {
+      int fast = fast_frame();
+      int ref = reference_frame();
+      if (compare(false) != 0 || fast != ref) {
+        report(frame);
+        return EXIT_FAILURE;
+      }
+      if (ref == -1) {
+        printf("PC left program memory after %" PRIu64
+               " instructions, cores agree\n",
+               RETIRED);
+        return EXIT_SUCCESS;
+      }
+      continue;
+    }
+
+    // same budget as frame_run, without idle loop skipping
+    uint32_t left = (rate + rest) / FRAMES_PER_SECOND;
+    rest = (rate + rest) % FRAMES_PER_SECOND;
+    while (left != 0) {
+      if (REF.registers.PC.v >= AVALIABLE_MEMORY_END) {
+        printf("PC left program memory after %" PRIu64
+               " instructions, cores agree\n",
+               RETIRED);
+        return EXIT_SUCCESS;
+      }
+      uint32_t n = fast_run(left);
+      reference_run(n);
+      left -= n;
+      if (compare(false) != 0) {
+        report(frame);
+        return EXIT_FAILURE;
+      }
+    }
+
+    REF.timers.delay -= REF.timers.delay != 0;
+    REF.timers.sound -= REF.timers.sound != 0;
+    FAST.timers.delay -= FAST.timers.delay != 0;
+    FAST.timers.sound -= FAST.timers.sound != 0;
+  }
+  printf("%" PRIu64 " instructions in %u frames, cores agree\n", RETIRED,
+         frames);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,331 @@
+// runs ROMs headless for a fixed number of frames and compares the screen
+// against golden images. every test runs in its own process
+#include "chip8.h"
+#include "log.h"
+#include <inttypes.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_TESTS (256)
+#define MAX_EVENTS (32)
+#define MAX_PATH (512)
+#define MAX_ROM_SIZE (4096)
+
+typedef struct {
+  uint32_t frame;
+  uint16_t key;
+  bool press;
+} event_t;
+
+typedef struct {
+  char name[64];
+  char rom[MAX_PATH];
+  uint32_t frames;
+  uint16_t ips;
+  uint32_t events_count;
+  event_t events[MAX_EVENTS];
+} test_t;
+
+typedef enum : int {
+  RESULT_PASS,
+  RESULT_FAIL,
+  RESULT_SKIP, // rom is not there, fails the run all the same
+  RESULT_ERROR,
+} result_t;
+
+// keeps results apart from exit codes of sanitizers and assert
+#define RESULT_EXIT_BASE (64)
+
+static const char *const RESULT_NAMES[] = {
+    [RESULT_PASS] = "PASS",
+    [RESULT_FAIL] = "FAIL",
+    [RESULT_SKIP] = "SKIP",
+    [RESULT_ERROR] = "ERROR",
+};
+
+typedef chip8_row_t image_t[CHIP8_HEIGHT];
+
+static test_t TESTS[MAX_TESTS];
+static uint32_t TESTS_COUNT = 0;
+static const char *GOLDEN_DIR = nullptr;
+static const char *OUT_DIR = "build/regress-out";
+static bool RECORD = false;
+
+static int fclose_cleanup(FILE **f) { return *f ? fclose(*f) : 0; }
+static void chip8_cleanup(chip8_t **m) { chip8_destroy(*m); }
+
+// `frame:+K` presses, `frame:-K` releases hex key K before that frame
+static int event_parse(const char *str, event_t *e) {
+  char sign;
+  uint32_t key;
+  if (sscanf(str, "%u:%c%x", &e->frame, &sign, &key) != 3 || key > 0xF ||
+      (sign != '+' && sign != '-'))
+    return -1;
+  e->key = key;
+  e->press = sign == '+';
+  return 0;
+}
+
+// one test per line: name rom frames ips [events...], # starts a comment.
+// rom is relative to the manifest
+static int manifest_parse(const char *path) {
+  [[gnu::cleanup(fclose_cleanup)]] FILE *f = fopen(path, "r");
+  EXPECT(f != nullptr, ({
+           printf("Failed to read manifest %s\n", path);
+           return -1;
+         }));
+
+  char buf[MAX_PATH];
+  snprintf(buf, sizeof(buf), "%s", path);
+  const char *dir = dirname(buf);
+
+  char line[1024];
+  for (uint32_t n = 1; fgets(line, sizeof(line), f) != nullptr; n++) {
+    line[strcspn(line, "#\n")] = '\0';
+    char *save = nullptr;
+    char *name = strtok_r(line, " \t", &save);
+    if (name == nullptr)
+      continue;
+
+    EXPECT(TESTS_COUNT < MAX_TESTS, ({
+             printf("%s:%u: too many tests\n", path, n);
+             return -1;
+           }));
+    test_t *t = &TESTS[TESTS_COUNT];
+    char *rom = strtok_r(nullptr, " \t", &save);
+    char *frames = strtok_r(nullptr, " \t", &save);
+    char *ips = strtok_r(nullptr, " \t", &save);
+    EXPECT(rom != nullptr && frames != nullptr && ips != nullptr, ({
+             printf("%s:%u: expected name rom frames ips\n", path, n);
+             return -1;
+           }));
+    *t = (test_t){.frames = strtoul(frames, nullptr, 10),
+                  .ips = strtoul(ips, nullptr, 10)};
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    snprintf(t->rom, sizeof(t->rom), "%s/%s", dir, rom);
+
+    char *event;
+    while ((event = strtok_r(nullptr, " \t", &save)) != nullptr) {
+      EXPECT(t->events_count < MAX_EVENTS &&
+                 event_parse(event, &t->events[t->events_count]) != -1,
+             ({
+               printf("%s:%u: bad input event %s\n", path, n, event);
+               return -1;
+             }));
+      t->events_count++;
+    }
+    TESTS_COUNT++;
+  }
+  return 0;
+}
+
+static int image_read(const char *path, image_t img) {
+  [[gnu::cleanup(fclose_cleanup)]] FILE *f = fopen(path, "rb");
+  uint32_t w, h;
+  if (f == nullptr || fscanf(f, "P4 %u %u", &w, &h) != 2 ||
+      w != CHIP8_WIDTH || h != CHIP8_HEIGHT || fgetc(f) == EOF)
+    return -1;
+  return fread(img, sizeof(image_t), 1, f) == 1 ? 0 : -1;
+}
+
+// binary pbm has the same layout as the framebuffer
+static int image_write(const char *path, const image_t img) {
+  [[gnu::cleanup(fclose_cleanup)]] FILE *f = fopen(path, "wb");
+  if (f == nullptr)
+    return -1;
+  fprintf(f, "P4\n%u %u\n", CHIP8_WIDTH, CHIP8_HEIGHT);
+  return fwrite(img, sizeof(image_t), 1, f) == 1 ? 0 : -1;
+}
+
+static uint64_t image_hash(const image_t img) {
+  uint64_t h = 0xcbf29ce484222325; // FNV-1a
+  const uint8_t *p = (const uint8_t *)img;
+  for (uint32_t i = 0; i < sizeof(image_t); i++)
+    h = (h ^ p[i]) * 0x100000001b3;
+  return h;
+}
+
+static result_t test_run(const test_t *t) {
+  [[gnu::cleanup(fclose_cleanup)]] FILE *rom = fopen(t->rom, "rb");
+  if (rom == nullptr)
+    return RESULT_SKIP;
+
+  uint8_t buf[MAX_ROM_SIZE];
+  size_t size = fread(buf, sizeof(*buf), sizeof(buf), rom);
+  [[gnu::cleanup(chip8_cleanup)]] chip8_t *m = chip8_create(t->ips);
+  if (m == nullptr || chip8_load(m, buf, size, CHIP8_PROGRAM_START) == -1) {
+    printf("%s: failed to load %s\n", t->name, t->rom);
+    return RESULT_ERROR;
+  }
+
+  uint16_t keys = 0;
+  for (uint32_t frame = 0; frame < t->frames; frame++) {
+    for (uint32_t e = 0; e < t->events_count; e++) {
+      const event_t *event = &t->events[e];
+      if (event->frame != frame)
+        continue;
+      if (event->press)
+        keys |= 1 << event->key;
+      else
+        keys &= ~(1 << event->key);
+    }
+    chip8_set_keys(m, keys);
+    if (chip8_run_frame(m) == -1)
+      break;
+  }
+
+  image_t actual, golden, diff;
+  memcpy(actual, chip8_framebuffer(m), sizeof(actual));
+  char path[MAX_PATH];
+  snprintf(path, sizeof(path), "%s/%s.pbm", OUT_DIR, t->name);
+  if (image_write(path, actual) == -1) {
+    printf("%s: failed to write %s: %s\n", t->name, path, strerror(errno));
+    return RESULT_ERROR;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s.pbm", GOLDEN_DIR, t->name);
+  if (RECORD)
+    return image_write(path, actual) == -1 ? RESULT_ERROR : RESULT_PASS;
+  if (image_read(path, golden) == -1) {
+    printf("%s: no golden %s, record it with -r\n", t->name, path);
+    return RESULT_FAIL;
+  }
+  if (memcmp(actual, golden, sizeof(actual)) == 0)
+    return RESULT_PASS;
+
+  for (uint32_t y = 0; y < CHIP8_HEIGHT; y++)
+    for (uint32_t b = 0; b < CHIP8_PITCH; b++)
+      diff[y][b] = actual[y][b] ^ golden[y][b];
+  snprintf(path, sizeof(path), "%s/%s.diff.pbm", OUT_DIR, t->name);
+  if (image_write(path, diff) == -1) {
+    printf("%s: failed to write %s: %s\n", t->name, path, strerror(errno));
+    return RESULT_ERROR;
+  }
+  printf("%s: screen %016" PRIx64 ", golden %016" PRIx64 ", diff in %s\n",
+         t->name, image_hash(actual), image_hash(golden), path);
+  return RESULT_FAIL;
+}
+
+static bool test_selected(const test_t *t, char *names[], int count) {
+  if (count == 0)
+    return true;
+  for (int i = 0; i < count; i++) {
+    if (strcmp(t->name, names[i]) == 0)
+      return true;
+  }
+  return false;
+}
+
+static int usage(const char *name) {
+  printf("usage: %s [-r] [-j jobs] [-g golden dir] [-o out dir] <manifest> "
+         "[test...]\n"
+         "  -r records goldens instead of comparing\n",
+         name);
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  char option;
+  while ((option = getopt(argc, argv, "rj:g:o:")) != -1) {
+    switch (option) {
+    case 'r':
+      RECORD = true;
+      break;
+    case 'j':
+      jobs = strtol(optarg, nullptr, 10);
+      break;
+    case 'g':
+      GOLDEN_DIR = optarg;
+      break;
+    case 'o':
+      OUT_DIR = optarg;
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind >= argc || jobs < 1)
+    return usage(argv[0]);
+  if (manifest_parse(argv[optind]) == -1)
+    return EXIT_FAILURE;
+
+  // goldens live next to the manifest by default
+  char golden_dir[MAX_PATH], buf[MAX_PATH];
+  if (GOLDEN_DIR == nullptr) {
+    snprintf(buf, sizeof(buf), "%s", argv[optind]);
+    snprintf(golden_dir, sizeof(golden_dir), "%s/golden", dirname(buf));
+    GOLDEN_DIR = golden_dir;
+  }
+  EXPECT(mkdir(OUT_DIR, 0755) != -1 || errno == EEXIST, ({
+           printf("Failed to create %s\n", OUT_DIR);
+           return EXIT_FAILURE;
+         }));
+
+  pid_t pids[MAX_TESTS] = {};
+  result_t results[MAX_TESTS] = {};
+  char **names = argv + optind + 1;
+  int names_count = argc - optind - 1;
+  uint32_t running = 0, next = 0, done = 0, selected = 0;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (done < selected || next < TESTS_COUNT) {
+    if (next < TESTS_COUNT && running < jobs) {
+      test_t *t = &TESTS[next++];
+      if (!test_selected(t, names, names_count))
+        continue;
+      selected++;
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0)
+        _exit(RESULT_EXIT_BASE + test_run(t));
+      EXPECT(pid != -1, ({
+               printf("fork failed: %s\n", strerror(errno));
+               return EXIT_FAILURE;
+             }));
+      pids[t - TESTS] = pid;
+      running++;
+      continue;
+    }
+
+    int status;
+    pid_t pid = wait(&status);
+    if (pid == -1)
+      break;
+    for (uint32_t i = 0; i < TESTS_COUNT; i++) {
+      if (pids[i] != pid)
+        continue;
+      int code = WIFEXITED(status) ? WEXITSTATUS(status) - RESULT_EXIT_BASE
+                                   : RESULT_ERROR;
+      // crashed, asserted or a sanitizer found something
+      results[i] = code >= RESULT_PASS && code <= RESULT_ERROR ? code
+                                                               : RESULT_ERROR;
+      printf("%-5s %s\n", RESULT_NAMES[results[i]], TESTS[i].name);
+    }
+    running--;
+    done++;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  uint32_t counts[ARRAY_SIZE(RESULT_NAMES)] = {};
+  for (uint32_t i = 0; i < TESTS_COUNT; i++) {
+    if (pids[i] != 0)
+      counts[results[i]]++;
+  }
+  printf("%u passed, %u failed, %u skipped, %u errors in %.2fs\n",
+         counts[RESULT_PASS], counts[RESULT_FAIL], counts[RESULT_SKIP],
+         counts[RESULT_ERROR],
+         (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+  // a run missing its roms tested nothing, it does not pass
+  return counts[RESULT_FAIL] || counts[RESULT_SKIP] || counts[RESULT_ERROR]
+             ? EXIT_FAILURE
+             : EXIT_SUCCESS;
+}
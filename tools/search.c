@@ -0,0 +1,169 @@
+// beam search for key inputs maximizing bytes of guest memory. prints the best
+// route as input events a regress manifest takes
+#include "search.h"
+#include "log.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ROM_SIZE (4096)
+
+static int fclose_cleanup(FILE **f) { return *f ? fclose(*f) : 0; }
+static void free_cleanup(void *p) { free(*(void **)p); }
+static void chip8_cleanup(chip8_t **m) { chip8_destroy(*m); }
+static void search_cleanup(search_t **s) { search_destroy(*s); }
+
+// `address[:weight]`, weight defaults to 1
+static int term_parse(const char *str, search_term_t *t) {
+  char *end = nullptr;
+  long address = strtol(str, &end, 0);
+  if (end == str || address < 0 || address > 0xFFF)
+    return -1;
+  t->address = address;
+  t->weight = 1;
+  if (*end == ':') {
+    const char *weight = end + 1;
+    t->weight = strtol(weight, &end, 0);
+    if (end == weight)
+      return -1;
+  }
+  return *end == '\0' ? 0 : -1;
+}
+
+// hex digits of keys tried alone, nothing held is always tried too
+static int keys_parse(const char *str, search_config_t *c) {
+  c->actions_count = 1;
+  c->actions[0] = 0;
+  for (; *str != '\0'; str++) {
+    char digit[2] = {*str};
+    char *end = nullptr;
+    long key = strtol(digit, &end, 16);
+    if (*end != '\0')
+      return -1;
+    c->actions[c->actions_count++] = 1 << key;
+  }
+  return 0;
+}
+
+// `frame:+K` and `frame:-K` whenever a key goes down or up, no key is held
+// during the first `offset` frames
+static void route_print(const uint16_t *keys, uint32_t rounds, uint32_t offset,
+                        uint32_t frames) {
+  uint16_t held = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    uint16_t changed = held ^ keys[r];
+    for (uint32_t k = 0; k < 16; k++) {
+      if (changed & (1 << k))
+        printf(" %u:%c%X", offset + r * frames,
+               keys[r] & (1 << k) ? '+' : '-', k);
+    }
+    held = keys[r];
+  }
+  printf("\n");
+}
+
+static int usage(const char *name) {
+  printf("usage: %s -o address[:weight]... [-w width] [-f frames] "
+         "[-r rounds] [-k keys] [-W warmup frames] [-t threads] [-i ips] "
+         "[-s start] <rom>\n"
+         "  -o scores a state by its byte at address times weight, repeat to "
+         "add up\n"
+         "  -k hex digits of keys tried, every key by default\n",
+         name);
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  search_config_t config = {.width = 64, .frames = 10};
+  uint32_t rounds = 100, warmup = 0;
+  uint16_t ips = 1000, start = CHIP8_PROGRAM_START;
+  char option;
+  while ((option = getopt(argc, argv, "o:w:f:r:k:W:t:i:s:")) != -1) {
+    switch (option) {
+    case 'o':
+      if (config.objective_count == SEARCH_MAX_TERMS ||
+          term_parse(optarg, &config.objective[config.objective_count++]) ==
+              -1)
+        return usage(argv[0]);
+      break;
+    case 'w':
+      config.width = strtoul(optarg, nullptr, 10);
+      break;
+    case 'f':
+      config.frames = strtoul(optarg, nullptr, 10);
+      break;
+    case 'r':
+      rounds = strtoul(optarg, nullptr, 10);
+      break;
+    case 'k':
+      if (strlen(optarg) >= SEARCH_MAX_ACTIONS ||
+          keys_parse(optarg, &config) == -1)
+        return usage(argv[0]);
+      break;
+    case 'W':
+      warmup = strtoul(optarg, nullptr, 10);
+      break;
+    case 't':
+      config.threads = strtoul(optarg, nullptr, 10);
+      break;
+    case 'i':
+      ips = strtoul(optarg, nullptr, 10);
+      break;
+    case 's':
+      start = strtoul(optarg, nullptr, 0);
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || config.objective_count == 0 || config.width == 0)
+    return usage(argv[0]);
+
+  [[gnu::cleanup(fclose_cleanup)]] FILE *f = fopen(argv[optind], "rb");
+  EXPECT(f != nullptr, ({
+           printf("Failed to read program %s\n", argv[optind]);
+           return EXIT_FAILURE;
+         }));
+  uint8_t rom[MAX_ROM_SIZE];
+  size_t size = fread(rom, sizeof(*rom), sizeof(rom), f);
+  [[gnu::cleanup(chip8_cleanup)]] chip8_t *m = chip8_create(ips);
+  EXPECT(m != nullptr && chip8_load(m, rom, size, start) != -1, ({
+           printf("Failed to load %s\n", argv[optind]);
+           return EXIT_FAILURE;
+         }));
+  for (uint32_t w = 0; w < warmup; w++) {
+    if (chip8_run_frame(m) == -1)
+      break;
+  }
+
+  [[gnu::cleanup(search_cleanup)]] search_t *s = search_create(m, &config);
+  [[gnu::cleanup(free_cleanup)]] uint16_t *keys =
+      calloc(rounds + 1, sizeof(*keys));
+  EXPECT(s != nullptr && keys != nullptr, ({
+           printf("Failed to create search %u states wide\n", config.width);
+           return EXIT_FAILURE;
+         }));
+
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  uint32_t round = 0;
+  for (; round < rounds && search_round(s) != 0; round++)
+    printf("round %u: best %" PRId64 ", beam %u, %" PRIu64
+           " distinct states\n",
+           round + 1, search_score(s, 0), search_width(s), search_visited(s));
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  printf("%u rounds in %.2fs, %" PRIu64 " states, %.0f states/s, best %" PRId64
+         "\n",
+         round, seconds, search_explored(s), search_explored(s) / seconds,
+         search_score(s, 0));
+  uint32_t length = search_route(s, 0, keys, rounds + 1);
+  printf("route:");
+  route_print(keys, length, warmup, config.frames ? config.frames : 1);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+// spectator for `chip-8 -S <path>`. rebuilds the screen from the xor deltas
+#include "framebuffer.h"
+#include "log.h"
+#include "periph.h"
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void exit_cleanup(void) { display_exit(); }
+
+static bool read_full(int fd, void *buf, size_t size) {
+  uint8_t *p = buf;
+  while (size != 0) {
+    ssize_t n = read(fd, p, size);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static int viewer_connect(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  EXPECT(strlen(path) < sizeof(addr.sun_path), ({
+           printf("Socket path is too long %s\n", path);
+           return -1;
+         }));
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  EXPECT(fd != -1 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != -1,
+         ({
+           printf("Failed to connect to %s\n", path);
+           return -1;
+         }));
+  return fd;
+}
+
+int main(int argc, char *argv[]) {
+  renderer_t renderer = RENDERER_ASCII;
+  char option;
+  while ((option = getopt(argc, argv, "r:")) != -1) {
+    switch (option) {
+    case 'r':
+      if (strcmp(optarg, "half") == 0)
+        renderer = RENDERER_HALF_BLOCK;
+      else if (strcmp(optarg, "braille") == 0)
+        renderer = RENDERER_BRAILLE;
+      else if (strcmp(optarg, "ascii") != 0)
+        goto usage;
+      break;
+    default:
+      goto usage;
+    }
+  }
+  if (optind != argc - 1)
+    goto usage;
+
+  int fd = viewer_connect(argv[optind]);
+  if (fd == -1)
+    return EXIT_FAILURE;
+
+  atexit(&exit_cleanup);
+  EXPECT(display_init(renderer) != -1, ({ return EXIT_FAILURE; }));
+
+  framebuffer_row_t fb[HEIGHT] = {};
+  stream_header_t header;
+  while (read_full(fd, &header, sizeof(header))) {
+    EXPECT(header.magic == STREAM_MAGIC, ({
+             LOG_ERROR("bad magic %#x", header.magic);
+             return EXIT_FAILURE;
+           }));
+    for (uint32_t y = 0; y < HEIGHT; y++) {
+      if ((header.rows & ((uint32_t)1 << y)) == 0)
+        continue;
+      framebuffer_row_t delta;
+      if (!read_full(fd, delta, sizeof(delta)))
+        return EXIT_SUCCESS;
+      for (uint32_t b = 0; b < FRAMEBUFFER_PITCH; b++)
+        fb[y][b] ^= delta[b];
+    }
+    display_present(fb);
+  }
+  return EXIT_SUCCESS; // emulator went away or dropped us
+
+usage:
+  printf("usage: %s [-r ascii|half|braille] <socket>\n", argv[0]);
+  return EXIT_FAILURE;
+}